@@ -0,0 +1,135 @@
+//******************************************************************************
+// parallel.h -- This file is part of Doux, a realtime softbody simulation library
+//
+// Copyright (C) 2021 Changxi Zheng <cxz@cs.columbia.edu>
+//
+// This Source Code Form is subject to the terms of the Mozilla Public License
+// v. 2.0. If a copy of the MPL was not distributed with this file, You can
+// obtain one at http://mozilla.org/MPL/2.0/.
+//******************************************************************************
+
+#pragma once
+
+/*
+ * A light-weight thread pool for data-parallel loops, so no external
+ * library (e.g., TBB) is needed for parallel computing.
+ *
+ * The chunks of a loop are scheduled by work stealing: every thread starts
+ * with a contiguous range of the chunks, processes it from the front, and 
+ * once it runs out, steals the back half of the range of another thread.
+ * The chunk boundaries only depend on the loop size and the grain, not on 
+ * the scheduling, so a loop body that writes per chunk is deterministic.
+ */
+
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+#include "doux/core/platform.h"
+
+NAMESPACE_BEGIN(doux)
+
+class ThreadPool {
+ public:
+  // nthreads: total number of threads including the calling thread.
+  //           If it is zero, the number of hardware threads is used.
+  explicit ThreadPool(size_t nthreads = 0);
+  ~ThreadPool();
+
+  ThreadPool(const ThreadPool&) = delete;
+  ThreadPool(ThreadPool&&) = delete;
+  ThreadPool& operator = (const ThreadPool&) = delete;
+  ThreadPool& operator = (ThreadPool&&) = delete;
+
+  // return the number of threads, including the calling thread
+  [[nodiscard]] DOUX_ALWAYS_INLINE
+  size_t num_threads() const noexcept { return workers_.size() + 1; }
+
+  /*
+   * Split [0, n) into chunks of (at most) `grain` indices, and call fn(b, e)
+   * on every chunk [b, e) in parallel. The calling thread also processes
+   * chunks, and the method returns only after all chunks are processed.
+   *
+   * Calls from inside a running loop body are executed serially.
+   *
+   * If fn throws, the chunks not started yet are skipped, and the first 
+   * exception is rethrown once all running chunks are finished.
+   */
+  template <typename Func_>
+  void parallel_for(size_t n, size_t grain, Func_&& fn) {
+    if ( n == 0 ) [[unlikely]] return;
+    grain = grain == 0 ? 1 : grain;
+    if ( workers_.empty() || n <= grain || in_pool_ ) {
+      fn(static_cast<size_t>(0), n);
+      return;
+    }
+
+    using F = std::remove_reference_t<Func_>;
+    run(n, grain,
+        [](void* f, size_t b, size_t e) { (*static_cast<F*>(f))(b, e); },
+        const_cast<void*>(static_cast<const void*>(&fn)));
+  }
+
+ private:
+  using ChunkFunc = void (*)(void*, size_t, size_t);
+
+  void run(size_t n, size_t grain, ChunkFunc f, void* data);
+  // process the chunks of the current job until none is left
+  // slot: the range of chunks owned by the thread (0: the calling thread)
+  void work(size_t slot);
+  // take the first chunk c of the own range
+  bool pop(size_t slot, size_t& c);
+  // take the back half of the range of another thread, and its first chunk c
+  bool steal(size_t slot, size_t& c);
+  void worker_loop(size_t slot);
+
+ private:
+  std::vector<std::thread> workers_;
+
+  std::mutex              run_mtx_; // serialize the jobs from different threads
+  std::mutex              mtx_;
+  std::condition_variable job_cv_;  // notify workers of a new job
+  std::condition_variable done_cv_; // notify the caller of the job completion
+
+  // the current job, only modified in run() while no worker is active
+  ChunkFunc func_ {nullptr};
+  void*     data_ {nullptr};
+  size_t    n_ {0};
+  size_t    grain_ {1};
+  size_t    num_chunks_ {0};
+
+  // the remaining chunks [b, e) of a thread, packed as (b << 32 | e)
+  struct alignas(64) Slot {
+    std::atomic<uint64_t> range {0};
+  };
+  std::unique_ptr<Slot[]> slots_; // one for each thread
+
+  std::atomic<size_t> pending_ {0}; // number of unfinished chunks
+  std::atomic<bool>   failed_ {false};  // a chunk of the job has thrown
+  std::exception_ptr  error_;       // the first exception of the job (guarded by mtx_)
+  size_t    active_ {0};            // number of workers working on the job
+  uint64_t  gen_ {0};               // job generation
+  bool      stop_ {false};
+
+  // indicate if the current thread is running a loop body
+  static thread_local bool in_pool_;
+};
+
+// Return the global thread pool
+[[nodiscard]] ThreadPool& thread_pool();
+
+// Replace the global thread pool by one with nthreads threads (0: the number
+// of hardware threads). It must not be called while a loop is running.
+void set_num_threads(size_t nthreads);
+
+template <typename Func_>
+DOUX_ALWAYS_INLINE void parallel_for(size_t n, size_t grain, Func_&& fn) {
+  thread_pool().parallel_for(n, grain, std::forward<Func_>(fn));
+}
+
+NAMESPACE_END(doux)
@@ -36,6 +36,11 @@ using vec3_f_t = Eigen::Matrix<float, 3, 1>;
 using mat3_d_t = Eigen::Matrix<double, 3, 3>;
 using vec3_d_t = Eigen::Matrix<double, 3, 1>;
 
+// N x 4 row-major matrix to store N 3D vectors (e.g., vertex positions). 
+// The last column is padding, so each row can be processed as a SIMD 4-vector.
+using matrix_x4_r_t = Eigen::Matrix<real_t, Eigen::Dynamic, 4, Eigen::RowMajor>;
+using row4_r_t = Eigen::Matrix<real_t, 1, 4>;
+
 using matrix_ui_t = Eigen::Matrix<uint32_t, Eigen::Dynamic, Eigen::Dynamic>;
 using vector_ui_t = Eigen::Matrix<uint32_t, Eigen::Dynamic, 1>;
 
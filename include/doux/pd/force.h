@@ -34,7 +34,7 @@ class MassForce {
   auto const& coeff() const { return g_; }
 
   // apply the force to predict the vel and pos at the next timestep
-  inline void apply(PBDBody& body, real_t dt) const {
+  inline void apply(MotiveBody& body, real_t dt) const {
     body.predict_vel_pos(g_, dt);
   }
 
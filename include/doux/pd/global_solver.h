@@ -13,13 +13,26 @@
 #include "doux/doux.h"
 #include "doux/linalg/num_types.h"
 #include "softbody.h"
-#include <unordered_map>
+#include <bit>
 #include <cstring>
+#include <limits>
+#include <memory>
+#include <span>
+#include <stdexcept>
+#include <tuple>
+#include <Eigen/Cholesky>
+#include <Eigen/LU>
+#include <Eigen/SparseCore>
+#include <Eigen/SparseCholesky>
 
 NAMESPACE_BEGIN(doux::pd)
 
+class ProjEnergy;
+
 class GlobalSolver {
  public:
+  virtual ~GlobalSolver() = default;
+
   /* 
    * initialize the solver
    * 1. allocate space for sparse matrix A
@@ -27,7 +40,26 @@ class GlobalSolver {
    * 
    * dt2: dt^2
    */
-  void init(std::vector<ProjDynBody>& sb, real_t dt2);
+  virtual void init(std::vector<ProjDynBody>& sb, real_t dt2);
+
+  /*
+   * Change the timestep (i.e., dt^2) after init(). The sparsity pattern, and 
+   * the symbolic analysis of the solvers (e.g., orderings) are kept, and only
+   * the numeric values (and factorizations) are recomputed.
+   */
+  void refactor(real_t dt2);
+
+  [[nodiscard]] DOUX_ALWAYS_INLINE real_t dt2() const { return dt2_; }
+
+  /*
+   * This method is called after the collision energy terms of a PD timestep 
+   * are generated. Their matrix elements are collected separately from the
+   * base matrix assembled in init(), and are passed to update_colli_mat().
+   */
+  void update_colli_terms(const std::vector<std::unique_ptr<ProjEnergy>>& cons);
+
+  // return the number of free vertices involved in the collision energy terms
+  [[nodiscard]] DOUX_ALWAYS_INLINE size_t num_colli_vtx() const { return colli_vtx_.size(); }
 
   /*
    * This method is called at the beginning of subiterations in each PD timestep 
@@ -42,6 +74,24 @@ class GlobalSolver {
    */
   void store_pos(std::vector<ProjDynBody>& sb);
 
+  /*
+   * Keep the predicted positions of the free vertices of the softbodies in 
+   * the rows of the solution x, so begin_iter() and store_pos() need not 
+   * copy them in every iteration. It requires a Vec3r to have the layout of
+   * a row of x, i.e., (x, y, z, padding) with SIMD; otherwise nothing is done.
+   * The softbodies must be unbound before the solver is destroyed or 
+   * initialized again.
+   */
+  void bind_pos(std::vector<ProjDynBody>& sb);
+  // copy the positions back into the softbodies, and detach them from x
+  void unbind_pos(std::vector<ProjDynBody>& sb);
+
+  // return true if the free positions of the softbody are kept in x
+  [[nodiscard]] bool is_bound(const ProjDynBody& b) const {
+    return b.id() < body_vec_map_.size() && b.num_free_vs() > 0 &&
+           static_cast<const void*>(b.pred_free_) == x_.row(body_vec_map_[b.id()]).data();
+  }
+
   /*
    * prepare the RHS
    */
@@ -49,23 +99,100 @@ class GlobalSolver {
     std::memcpy(b_.data(), b0_.data(), sizeof(real_t) * b_.size());
   }
 
+  /*
+   * Add the RHS terms of the internal energies of the softbodies (passed to
+   * init()) and of the collision energy terms to b. 
+   *
+   * The energies supporting it (see ProjEnergy::num_proj_rows()) store their
+   * projections into P, and b += h^2 S P is computed row by row in parallel.
+   * The other internal energies are colored in init(), so that no two 
+   * energies of the same color share a free vertex, and those of each color
+   * scatter into b in parallel. The result does not depend on the number of
+   * threads.
+   */
+  void assemble_rhs(const std::vector<std::unique_ptr<ProjEnergy>>& cons);
+
   // Solve Ax = b
   virtual void solve() = 0;
 
+  // return the number of rows (i.e., the number of free vertices) of the global system
+  [[nodiscard]] DOUX_ALWAYS_INLINE size_t size() const { return diag_.size(); }
+
+  [[nodiscard]] DOUX_ALWAYS_INLINE const linalg::matrix_x4_r_t& rhs() const { return b_; }
+  [[nodiscard]] DOUX_ALWAYS_INLINE const linalg::matrix_x4_r_t& solution() const { return x_; }
+  // the solution is also the current iterate of the PD iterations, which can 
+  // be modified (e.g., extrapolated) before store_pos() is called
+  [[nodiscard]] DOUX_ALWAYS_INLINE linalg::matrix_x4_r_t& solution() { return x_; }
+
+  // Return the inertia energy 1/2 (x - s_n)^T M (x - s_n) of the current 
+  // iterate x, up to a constant. It is scaled by dt^2 like the matrix A.
+  [[nodiscard]] real_t inertia_energy() const;
+
+  // assemble the (symmetric) system matrix A as an Eigen sparse matrix
+  // with_colli: indicate if the current collision terms are included
+  [[nodiscard]] Eigen::SparseMatrix<real_t> system_matrix(bool with_colli = false) const;
+
   // -------------------------------------------------------------
   // these two methods will be called by ProjEnergy instances to 
   // fill in matrix elements according to their definitions
+  //
+  // The matrix is assembled in two passes over all energy terms (see init()):
+  // the COUNT pass only counts the off-diagonal entries of each row, and the 
+  // FILL pass writes the values into the preallocated CSR arrays.
   void add_elem(const ProjDynBody* sb, size_t vid, real_t val) {
-    diag_(vtx_id(sb, vid)) += val * dt2_;
+    if ( stage_ == AssembleStage::FILL || stage_ == AssembleStage::DIAG ) {
+      diag_(vtx_id(sb, vid)) += val;
+    }
+    if ( stage_ == AssembleStage::COUNT || stage_ == AssembleStage::DIAG ) {
+      elem_rows_.push_back(vtx_id(sb, vid));
+    } else if ( stage_ == AssembleStage::COLLI ) {
+      auto const i = colli_vtx_idx(vtx_id(sb, vid));
+      colli_elems_.emplace_back(i, i, val * dt2_);
+    }
   }
 
   void add_elem(const ProjDynBody* sb1, size_t vid1,
 			          const ProjDynBody* sb2, size_t vid2, real_t val) {
     auto const v1 = vtx_id(sb1, vid1);
     auto const v2 = vtx_id(sb2, vid2);
-    auto const vv = val * dt2_;
-    off_diag_map_[v1][v2] += vv;
-    off_diag_map_[v2][v1] += vv;
+    if ( stage_ == AssembleStage::COUNT ) {
+      ++ off_diag_ptr_[v1 + 1];
+      ++ off_diag_ptr_[v2 + 1];
+    } else if ( stage_ == AssembleStage::FILL ) {
+      off_diag_[fill_pos_[v1] ++] = MatElem(v2, val);
+      off_diag_[fill_pos_[v2] ++] = MatElem(v1, val);
+    } else if ( stage_ == AssembleStage::COLLI ) {
+      auto const i = colli_vtx_idx(v1);
+      auto const j = colli_vtx_idx(v2);
+      colli_elems_.emplace_back(i, j, val * dt2_);
+      colli_elems_.emplace_back(j, i, val * dt2_);
+    }
+  }
+
+  // This method will be called by ProjEnergy instances to add their 
+  // contributions (scaled by dt^2) to the RHS vector b
+  void add_rhs(const ProjDynBody* sb, size_t vid, const Vec3r& val) {
+    auto const v = vtx_id(sb, vid);
+    b_.row(v) += linalg::row4_r_t(val.x(), val.y(), val.z(), 0) * dt2_;
+  }
+
+  // This method is called by ProjEnergy::register_global_solve_rhs() in 
+  // init(): add val to the element of S at the row of the vertex, and the 
+  // k-th projection row of the energy
+  void add_rhs_elem(const ProjDynBody* sb, size_t vid, uint32_t k, real_t val) {
+    rhs_elems_.emplace_back(vtx_id(sb, vid), proj_row_ + k, val);
+  }
+
+  // These two methods will be called by ProjEnergy instances in the 
+  // matrix-free product q = A p (see mat_vec_free()): read the rows of p, 
+  // and add their contributions (scaled by dt^2) to the rows of q
+  [[nodiscard]] DOUX_ALWAYS_INLINE 
+  linalg::row4_r_t mat_vec_in(const ProjDynBody* sb, size_t vid) const {
+    return mv_in_->row(vtx_id(sb, vid));
+  }
+  DOUX_ALWAYS_INLINE
+  void mat_vec_out(const ProjDynBody* sb, size_t vid, const linalg::row4_r_t& val) {
+    mv_out_->row(vtx_id(sb, vid)) += val * dt2_;
   }
   // -------------------------------------------------------------
 
@@ -77,6 +204,40 @@ class GlobalSolver {
     return body_vec_map_[sb->id()] + sb->free_vtx_id(vid);
   }
 
+  // return the index of vertex v in colli_vtx_, and add it if not yet there
+  DOUX_ALWAYS_INLINE uint32_t colli_vtx_idx(size_t v) {
+    if ( colli_map_[v] == NO_COLLI ) {
+      colli_map_[v] = static_cast<uint32_t>(colli_vtx_.size());
+      colli_vtx_.push_back(static_cast<uint32_t>(v));
+    }
+    return colli_map_[v];
+  }
+
+  /*
+   * Called by update_colli_terms() once the collision matrix elements are
+   * collected in colli_vtx_ and colli_mat_. This default implementation 
+   * adds the diagonal elements to diag_, and only supports collision terms
+   * that do not couple different vertices.
+   */
+  virtual void update_colli_mat();
+
+  // Called by refactor() once the values of A are updated to the new dt^2, 
+  // followed by update_colli_mat(). The solvers should recompute the numeric
+  // part of their factorizations/preconditioners here.
+  virtual void factorize_numeric() {}
+
+  // A = M + h^2 K: update the values of A from the stored K
+  void scale_values();
+
+  // q = A p using the stored diag_ and off_diag_
+  void mat_vec_csr(const linalg::matrix_x4_r_t& p, linalg::matrix_x4_r_t& q) const;
+
+  /*
+   * q = A p without the collision terms, computed by the energy terms 
+   * instead of the stored matrix (only available in the matrix-free mode)
+   */
+  void mat_vec_free(const linalg::matrix_x4_r_t& p, linalg::matrix_x4_r_t& q);
+
  protected:
   struct MatElem {
     uint32_t cid {0}; // column ID of the matrix element
@@ -86,6 +247,20 @@ class GlobalSolver {
     MatElem(uint32_t c, real_t v) noexcept : cid{c}, val{v} {}
   };
 
+  enum struct AssembleStage : uint8_t {
+    COUNT = 0,  // count the number of off-diagonal elements in each row 
+    FILL = 1,   // fill in the matrix elements
+    COLLI = 2,  // collect the matrix elements of the collision energy terms
+    DIAG = 3,   // only fill in the diagonal elements (in the matrix-free mode)
+  };
+
+  // iterate over the off-diagonal elements of row i
+  [[nodiscard]] DOUX_ALWAYS_INLINE 
+  std::span<const MatElem> off_diag_row(size_t i) const {
+    return std::span{off_diag_.data() + off_diag_ptr_[i], 
+                     off_diag_ptr_[i+1] - off_diag_ptr_[i]};
+  }
+
   real_t dt2_;
 
   // map each softbody ID to its starting position in the sparse matrix/vector
@@ -93,23 +268,507 @@ class GlobalSolver {
   //                   the softbody with ID i
   std::vector<size_t> body_vec_map_;
 
+  // The matrix A is shared by x, y, and z coordinates, so all three 
+  // coordinates are solved in one pass: b_, x_ and b0_ are N x 4 row-major 
+  // matrices whose rows store (x, y, z, 0). Every matrix entry is then 
+  // loaded once and applied to a row as a SIMD 4-vector.
+  linalg::vector_r_t mass_; // mass of the free vertices
   linalg::vector_r_t diag_;
-  linalg::vector_r_t b_;  // RHS vector for Ax = b
-  linalg::vector_r_t x_;  // x vector for storing solving results
-  linalg::vector_r_t b0_; // M * s_n
+  linalg::matrix_x4_r_t b_;  // RHS vector for Ax = b
+  linalg::matrix_x4_r_t x_;  // x vector for storing solving results
+  linalg::matrix_x4_r_t b0_; // M * s_n
   
-  std::vector<std::vector<MatElem>> off_diag_;
+  // off-diagonal elements of A in CSR format: the elements of row i are 
+  // stored in off_diag_[off_diag_ptr_[i] : off_diag_ptr_[i+1]], sorted
+  // by their column IDs
+  std::vector<size_t>  off_diag_ptr_;
+  std::vector<MatElem> off_diag_;
 
   // backup the diag. elements, as the collision enregy terms 
   // may change them
   linalg::vector_r_t diag_backup_; 
-  std::vector<std::unordered_map<uint32_t, real_t>> off_diag_map_;
+
+  // K in A = M + h^2 K (excluding the collision terms): its diagonal, and 
+  // its off-diagonal values in the same order as off_diag_
+  linalg::vector_r_t  k_diag_;
+  std::vector<real_t> k_off_;
+
+  AssembleStage stage_ {AssembleStage::COUNT};
+  std::vector<size_t> fill_pos_;  // only used in the FILL stage
+
+  // The internal energies not gathered by S (see below) are colored 
+  // (greedily, with at most MAX_RHS_COLORS colors) for the parallel RHS 
+  // assembly. The energies that do not fit in any color go into the last 
+  // bucket, which is processed serially.
+  static constexpr uint32_t MAX_RHS_COLORS = 64;
+  std::vector<std::vector<ProjEnergy*>> rhs_colors_;
+  std::vector<uint32_t> elem_rows_;  // rows of the energy being registered
+
+  // RHS gather operator: b += h^2 S P, where the rows of P (stored in proj_)
+  // proj_ptr_[i] : proj_ptr_[i] + num_proj_rows() are written by 
+  // proj_energies_[i]. S is stored without h^2.
+  std::vector<ProjEnergy*> proj_energies_;
+  std::vector<size_t>      proj_ptr_;
+  // the batched energies are gathered by batch: the rows of the batch 
+  // proj_batches_[i] start from proj_batch_row_[i]
+  std::vector<const ProjEnergyBatch*> proj_batches_;
+  std::vector<size_t>                 proj_batch_row_;
+  Eigen::SparseMatrix<real_t, Eigen::RowMajor> rhs_op_;  // S
+  linalg::matrix_x4_r_t    proj_;
+  size_t proj_row_ {0};  // first row of the energy being registered
+  std::vector<Eigen::Triplet<real_t>> rhs_elems_;  // only used in init()
+
+  // assemble S for the energy batches and the energies in proj_energies_
+  void init_rhs_op(const std::vector<ProjDynBody>& sb);
+
+  // In the matrix-free mode (set by the subclasses before init()), no 
+  // off-diagonal element is stored, and A is applied through the energy terms
+  bool matrix_free_ {false};
+  // an internal energy term: term t of a batch, or e if batch is null
+  struct EnergyTerm {
+    const ProjEnergyBatch* batch;
+    const ProjEnergy*      e;
+    uint32_t               t;
+  };
+  // all internal energies, colored like rhs_colors_ (matrix-free mode only)
+  std::vector<std::vector<EnergyTerm>> mv_colors_;
+  const linalg::matrix_x4_r_t* mv_in_ {nullptr};
+  linalg::matrix_x4_r_t*       mv_out_ {nullptr};
+
+  // The collision energy terms change in every timestep. Their contribution
+  // to A is C restricted to the few vertices they involve: 
+  //   A_colli = A + E C E^T, 
+  // where E selects the vertices in colli_vtx_, and C is stored in colli_mat_.
+  static constexpr uint32_t NO_COLLI = std::numeric_limits<uint32_t>::max();
+  std::vector<uint32_t> colli_vtx_;  // free vertices involved in collisions
+  std::vector<uint32_t> colli_map_;  // vertex -> its index in colli_vtx_ (or NO_COLLI)
+  linalg::matrix_r_t    colli_mat_;  // C
+  // (row, col, value) of the collected collision elements (COLLI stage only)
+  std::vector<std::tuple<uint32_t, uint32_t, real_t>> colli_elems_;
 };
 
+/*
+ * Multicolor Gauss-Seidel solver for the global step.
+ *
+ * The rows of A are colored once in init() using a greedy coloring of the 
+ * off-diagonal pattern, so that no two rows of the same color are coupled.
+ * In each sweep, the rows of one color are then relaxed in parallel.
+ * The iterations start from the current x_, i.e., the result of the 
+ * previous PD iteration.
+ */
 class GlbGaussSeidelSolver : public GlobalSolver {
  public:
+  explicit GlbGaussSeidelSolver(uint32_t nsweeps = 20) noexcept : nsweeps_{nsweeps} {
+    assert(nsweeps > 0);
+  }
+
+  void init(std::vector<ProjDynBody>& sb, real_t dt2) override;
+
+  void solve() override;
+
+  // return the number of colors used to partition the rows
+  [[nodiscard]] DOUX_ALWAYS_INLINE 
+  size_t num_colors() const { return color_ptr_.empty() ? 0 : color_ptr_.size() - 1; }
+
+ private:
+  uint32_t nsweeps_; // number of GS sweeps in each solve
+
+  // rows of color c are color_rows_[color_ptr_[c] : color_ptr_[c+1]]
+  std::vector<size_t>   color_ptr_;
+  std::vector<uint32_t> color_rows_;
+};
+
+/*
+ * Damped (point) Jacobi solver for the global step.
+ *
+ * A is shared by the three coordinates, so the 3x3 diagonal block of a 
+ * vertex in the (x, y, z) system is only A_ii I, and this is plain Jacobi 
+ * on A: each vertex row (x, y, z, 0) is scaled by 1/A_ii as one 4-wide SIMD
+ * operation. All rows are updated in parallel with a fixed cost per 
+ * iteration, which suits a hard time budget, and the iterations start from
+ * the current x_. All collision terms are supported.
+ */
+class GlbJacobiSolver : public GlobalSolver {
+ public:
+  /*
+   * niters: number of Jacobi iterations in each solve
+   * omega:  damping factor, in (0, 1]
+   */
+  explicit GlbJacobiSolver(uint32_t niters = 30, real_t omega = static_cast<real_t>(2) / 3) noexcept :
+      niters_{niters}, omega_{omega} {
+    assert(niters > 0 && omega > 0 && omega <= 1);
+  }
+
+  void init(std::vector<ProjDynBody>& sb, real_t dt2) override;
+
+  void solve() override;
+
+ protected:
+  // the diagonal elements are added to diag_, and the others are applied in
+  // the residuals
+  void update_colli_mat() override;
+
+ private:
+  uint32_t niters_;
+  real_t   omega_;
+
+  linalg::vector_r_t    dinv_;  // inverse of the diagonal of A
+  linalg::matrix_x4_r_t r_;     // A x
+
+  // off-diagonal collision elements of the collision vertex i (with the 
+  // global rows as column IDs): colli_off_[colli_ptr_[i] : colli_ptr_[i+1]]
+  std::vector<size_t>   colli_ptr_;
+  std::vector<MatElem>  colli_off_;
+};
+
+/*
+ * Preconditioned conjugate gradient solver for the global step.
+ *
+ * It only needs the assembled CSR matrix, so the memory cost stays bounded
+ * for very large scenes where the factorization is prohibitive. The CG 
+ * iterations start from the current x_ (i.e., the result of the previous PD 
+ * iteration), so only a few of them are needed in each PD iteration. The x, 
+ * y and z coordinates are solved simultaneously, each with its own step sizes.
+ */
+class GlbPCGSolver : public GlobalSolver {
+ public:
+  enum struct Precond : uint8_t {
+    JACOBI = 0,  // diagonal preconditioner
+    IC0 = 1,     // incomplete Cholesky factorization with zero fill-in
+  };
+
+  /*
+   * max_iter:    maximum number of CG iterations in each solve
+   * tol:         relative residual ||b - Ax|| / ||b|| to stop the CG iterations
+   * matrix_free: if true, A is never assembled; A x is computed by the 
+   *              energy terms instead (only with the Jacobi preconditioner)
+   */
+  explicit GlbPCGSolver(Precond pc = Precond::JACOBI, uint32_t max_iter = 50, 
+                        real_t tol = 1E-5, bool matrix_free = false) :
+      pc_{pc}, max_iter_{max_iter}, tol_{tol} {
+    assert(max_iter > 0 && tol > 0);
+    if ( matrix_free && pc == Precond::IC0 ) [[unlikely]] {
+      throw std::invalid_argument("GlbPCGSolver: IC0 needs the assembled matrix");
+    }
+    matrix_free_ = matrix_free;
+  }
+
+  void init(std::vector<ProjDynBody>& sb, real_t dt2) override;
+
+  void solve() override;
+
+  // return the number of CG iterations used in the last solve
+  [[nodiscard]] DOUX_ALWAYS_INLINE uint32_t last_iters() const { return last_iters_; }
+
+ protected:
+  // All collision terms are supported: the diagonal elements are added to 
+  // diag_, and the others are applied in the matrix-vector products.
+  void update_colli_mat() override;
+
+  void factorize_numeric() override;
+
+ private:
+  // q = A p
+  void mat_vec(const linalg::matrix_x4_r_t& p, linalg::matrix_x4_r_t& q);
+  // z = P^{-1} r
+  void precond(const linalg::matrix_x4_r_t& r, linalg::matrix_x4_r_t& z) const;
+  // compute the IC(0) factor A ~ L L^T on the sparsity pattern of A
+  void factor_ic0();
+
+  Precond  pc_;
+  uint32_t max_iter_;
+  real_t   tol_;
+  uint32_t last_iters_ {0};
+
+  linalg::matrix_x4_r_t r_, z_, p_, q_;
+
+  // strictly lower part of the IC(0) factor in CSR format, and its diagonal
+  std::vector<size_t>  ic_ptr_;
+  std::vector<MatElem> ic_;
+  linalg::vector_r_t   ic_diag_;
+};
+
+/*
+ * Multigrid solver for the global step.
+ *
+ * The hierarchy is built once in init() by smoothed aggregation on the graph 
+ * of A, which is the vertex graph of the (tet) meshes: each aggregate of 
+ * neighboring vertices becomes a coarse vertex. The prolongation operator P 
+ * is the piecewise constant interpolation smoothed by one damped Jacobi step,
+ * and the coarse matrix is P^T A P. Each solve() runs a few V-cycles with 
+ * damped Jacobi smoothing, starting from the current x_, and the coarsest 
+ * level is solved directly. The cost of a V-cycle is linear in the number of
+ * vertices.
+ */
+class GlbMultigridSolver : public GlobalSolver {
+ public:
+  /*
+   * ncycles:     number of V-cycles in each solve
+   * nsmooth:     number of pre- and post-smoothing sweeps on each level
+   * coarse_size: the coarsening stops once a level has at most this many rows
+   */
+  explicit GlbMultigridSolver(uint32_t ncycles = 2, uint32_t nsmooth = 2, 
+                              size_t coarse_size = 64) noexcept :
+      ncycles_{ncycles}, nsmooth_{nsmooth}, coarse_size_{coarse_size} {
+    assert(ncycles > 0 && coarse_size > 0);
+  }
+
+  void init(std::vector<ProjDynBody>& sb, real_t dt2) override;
+
+  void solve() override;
+
+  [[nodiscard]] DOUX_ALWAYS_INLINE size_t num_levels() const { return levels_.size(); }
+
+  // return the number of rows at level l (0 is the finest level)
+  [[nodiscard]] DOUX_ALWAYS_INLINE 
+  size_t level_size(size_t l) const { return levels_[l].A.rows(); }
+
+ protected:
+  // The collision terms on the diagonal are added to the finest level.
+  void update_colli_mat() override;
+
+  void factorize_numeric() override;
 
  private:
+  using SpMat = Eigen::SparseMatrix<real_t, Eigen::RowMajor>;
+
+  struct Level {
+    SpMat A;
+    SpMat P;  // prolongation from the next coarser level
+    SpMat R;  // restriction P^T
+    linalg::vector_r_t    dinv;  // inverse of the diagonal of A
+    linalg::matrix_x4_r_t x, b, r;
+  };
+
+  // build the levels and factorize the coarsest one (without collisions)
+  void build_hierarchy();
+
+  void vcycle(size_t l);
+  // damped Jacobi sweeps on level l
+  void smooth(Level& lv);
+
+  uint32_t ncycles_;
+  uint32_t nsmooth_;
+  size_t   coarse_size_;
+
+  std::vector<Level> levels_;
+  // direct solver of the coarsest level (non-movable, hence on the heap)
+  std::unique_ptr<Eigen::SimplicialLDLT<Eigen::SparseMatrix<real_t>, Eigen::Lower>> coarse_;
+  std::vector<uint32_t> prev_colli_;  // collision vertices of the last update
+};
+
+/*
+ * Direct solver for the global step.
+ *
+ * The matrix A = M + h^2 \sum (w_i A_i^T A_i) stays constant as long as dt2 is
+ * unchanged, so it is factored (sparse LDL^T with AMD fill-reducing ordering) 
+ * only once in init(), and each solve() only needs the triangular solves.
+ * When dt2 changes, refactor() keeps the orderings and the structure of the
+ * factors, and only redoes the numeric factorization.
+ *
+ * Without collisions, A is block diagonal with one block for each softbody. 
+ * Each block is factored separately, and the blocks are solved in parallel.
+ */
+class GlbCholeskySolver : public GlobalSolver {
+ public:
+  /*
+   * max_rank: if the collision terms involve at most max_rank vertices, they
+   *           are applied as a low-rank (Woodbury) correction to the solves 
+   *           of the prefactored A. Otherwise, the blocks coupled by the 
+   *           collision terms (i.e., contact islands) are merged and refactored.
+   *           An island keeps its ordering while its collision pattern is 
+   *           unchanged, and its whole factor while the values are too.
+   */
+  explicit GlbCholeskySolver(uint32_t max_rank = 64) noexcept : max_rank_{max_rank} {}
+
+  void init(std::vector<ProjDynBody>& sb, real_t dt2) override;
+
+  /*
+   * Solve LDL^T x = b for x, y and z coordinates simultaneously. The 
+   * triangular solves traverse the factor L once, and apply each of its 
+   * entries to a whole (x, y, z, 0) row.
+   */
+  void solve() override;
+
+  // return true if the current collision terms are handled by refactoring
+  [[nodiscard]] DOUX_ALWAYS_INLINE bool refactored() const { return !islands_.empty(); }
+
+  // return the number of independent blocks solved in solve()
+  [[nodiscard]] DOUX_ALWAYS_INLINE size_t num_blocks() const { return active_.size(); }
+
+  // return the number of contact islands (re)factored in the last update of
+  // the collision terms, i.e., without the ones whose factor was kept
+  [[nodiscard]] DOUX_ALWAYS_INLINE size_t num_factored_islands() const { return num_factored_; }
+
+ protected:
+  void update_colli_mat() override;
+
+  // refactor the softbody blocks numerically
+  void factorize_numeric() override;
+
+ private:
+  using LDLT = Eigen::SimplicialLDLT<Eigen::SparseMatrix<real_t>, Eigen::Lower>;
+
+  // An independent diagonal block of the global system: the rows of a 
+  // softbody, or of a contact island when the collision terms are refactored
+  struct Block {
+    // (global) rows of A in this block; contiguous for a softbody block
+    std::vector<uint32_t> rows;
+    // Eigen's solvers are not movable, so keep it on the heap to allow 
+    // moving the solver into ProjDynSim
+    std::unique_ptr<LDLT>  ldlt;
+    linalg::matrix_x4_r_t  y;    // permuted RHS and intermediate results
+    // islands only: the sorted collision elements (global rows) in the 
+    // island, to reuse its ordering (same pattern) or its whole factor 
+    // (same values) in the next update
+    std::vector<std::tuple<uint32_t, uint32_t, real_t>> colli;
+  };
+
+  // factorize the block of A (with or without the collision terms), and 
+  // redo the symbolic analysis (ordering) if symbolic is true
+  void factorize(Block& blk, bool with_colli, bool symbolic);
+
+  // solve the rows of x_ in a block
+  void solve_block(Block& blk);
+
+  uint32_t max_rank_;
+
+  std::vector<Block>    blocks_;     // one block for each softbody
+  std::vector<Block>    islands_;    // contact islands with the collision terms
+  std::vector<Block*>   active_;     // the blocks that partition all rows of A
+  std::vector<uint32_t> row_block_;  // row -> index of its block in blocks_
+  std::vector<uint32_t> loc_;        // row -> its index in a block (used in factorize())
+  bool islands_stale_ {false};      // A changed, so the island values must be refactored
+  size_t num_factored_ {0};         // see num_factored_islands()
+
+  // Woodbury correction of the collision terms:
+  //   (A + E C E^T)^{-1} b = x0 - Z (I + C E^T Z)^{-1} C E^T x0, 
+  // where x0 = A^{-1} b and Z = A^{-1} E. The columns of Z of the collision
+  // vertices in a block are only nonzero on the rows of the block.
+  struct ColliBlock {
+    uint32_t              blk;   // index in blocks_
+    std::vector<uint32_t> cols;  // the collision vertices (indices in colli_vtx_) in the block
+    linalg::matrix_r_t    Z;     // Z on the rows of the block and the columns cols
+    linalg::matrix_x4_r_t t;     // temporary rows of t_ of the columns cols
+  };
+  std::vector<ColliBlock>               colli_blocks_;
+  Eigen::PartialPivLU<linalg::matrix_r_t> cap_lu_; // LU of I + C E^T Z
+  linalg::matrix_x4_r_t                 t_;  // temporary k x 4 matrix
+};
+
+/*
+ * Mixed-precision direct solver for the global step.
+ *
+ * The LDL^T factor of A is computed and stored in single precision, which 
+ * halves its size and the memory traffic of the triangular solves, while the
+ * iterate and the residuals are kept in double. Each solve applies a few 
+ * steps of iterative refinement, x += A^{-1} (b - A x), which converge to 
+ * the solution in double, so the result is accurate to the precision of 
+ * real_t in both builds. The collision terms may only change the diagonal 
+ * of A; the factor is then recomputed numerically.
+ */
+class GlbMixedCholeskySolver : public GlobalSolver {
+ public:
+  // nrefine: number of refinement steps in each solve
+  explicit GlbMixedCholeskySolver(uint32_t nrefine = 2) noexcept : nrefine_{nrefine} {}
+
+  void init(std::vector<ProjDynBody>& sb, real_t dt2) override;
+
+  void solve() override;
+
+ protected:
+  void update_colli_mat() override;
+
+ private:
+  using matrix_x4_f_t = Eigen::Matrix<float, Eigen::Dynamic, 4, Eigen::RowMajor>;
+  using matrix_x4_d_t = Eigen::Matrix<double, Eigen::Dynamic, 4, Eigen::RowMajor>;
+
+  void factorize();
+
+  uint32_t nrefine_;
+
+  // Eigen's solvers are not movable, so keep it on the heap
+  std::unique_ptr<Eigen::SimplicialLDLT<Eigen::SparseMatrix<float>, Eigen::Lower>> ldlt_;
+  matrix_x4_d_t xd_;  // the iterate in double
+  matrix_x4_d_t r_;   // residual b - A x
+  matrix_x4_f_t y_;   // single-precision RHS and corrections
+};
+
+/*
+ * Domain-decomposed direct solver for the global step.
+ *
+ * The rows of A are partitioned on its graph into parts, which are slabs of 
+ * the breadth-first level sets, and the rows coupled to a later part form the
+ * interface G. The interiors I of different parts are then decoupled, i.e., 
+ * A_II is block diagonal, so the parts are factored and solved in parallel. 
+ * The interface unknowns solve the Schur complement system
+ *   S x_G = b_G - A_GI A_II^{-1} b_I,  S = A_GG - A_GI A_II^{-1} A_IG,
+ * whose size grows with the area of the cuts rather than the volume. A part
+ * only couples the interface rows next to it, so S is sparse (block 
+ * tridiagonal for the slabs of a single body), and it is factored by a 
+ * sparse LDLT with a fixed pattern. Unlike
+ * GlbCholeskySolver, a single large softbody is split across the threads.
+ *
+ * The collision terms may only change the diagonal of A; the affected parts 
+ * and S are then refactored.
+ */
+class GlbSchurSolver : public GlobalSolver {
+ public:
+  // nparts: number of parts (0: the number of threads)
+  explicit GlbSchurSolver(uint32_t nparts = 0) noexcept : nparts_{nparts} {}
+
+  void init(std::vector<ProjDynBody>& sb, real_t dt2) override;
+
+  void solve() override;
+
+  [[nodiscard]] DOUX_ALWAYS_INLINE size_t num_parts() const { return parts_.size(); }
+
+  // return the number of interface rows
+  [[nodiscard]] DOUX_ALWAYS_INLINE size_t interface_size() const { return iface_.size(); }
+
+  // return the number of stored entries of S (its lower triangle)
+  [[nodiscard]] DOUX_ALWAYS_INLINE size_t schur_nonzeros() const { return S_.nonZeros(); }
+
+ protected:
+  void update_colli_mat() override;
+
+  void factorize_numeric() override;
+
+ private:
+  using LDLT = Eigen::SimplicialLDLT<Eigen::SparseMatrix<real_t>, Eigen::Lower>;
+
+  static constexpr uint32_t IFACE = std::numeric_limits<uint32_t>::max();
+
+  struct Part {
+    std::vector<uint32_t> rows;   // interior rows of A
+    std::vector<uint32_t> iface;  // coupled interface rows (indices into iface_)
+    // Eigen's solvers are not movable, so keep it on the heap
+    std::unique_ptr<LDLT>       ldlt;  // factor of the interior block A_pp
+    Eigen::SparseMatrix<real_t> C;     // coupling block A_{p,iface}
+    // column of C of each off-diagonal entry of the rows (in order), or IFACE
+    std::vector<uint32_t>       ccol;
+    linalg::matrix_r_t          W;     // A_pp^{-1} C
+    linalg::matrix_r_t          T;     // C^T W, subtracted from S
+    linalg::matrix_x4_r_t       y, t;  // interior and interface temporaries
+  };
+
+  // factorize the interior block of a part, and compute its contribution to S
+  void factorize_part(Part& p, bool symbolic);
+  // assemble and factorize S
+  void factorize_schur(bool symbolic);
+
+  uint32_t nparts_;
+
+  std::vector<Part>     parts_;
+  std::vector<uint32_t> iface_;  // interface rows
+  std::vector<uint32_t> part_;   // row -> its part, or IFACE
+  std::vector<uint32_t> loc_;    // row -> its index in its part, or in iface_
+
+  Eigen::SparseMatrix<real_t> S_;
+  std::unique_ptr<LDLT>       S_ldlt_;
+  linalg::matrix_x4_r_t       g_;  // interface RHS and solution
+
+  std::vector<uint32_t> prev_colli_;  // collision vertices of the last update
 };
 
 NAMESPACE_END(doux::pd)
\ No newline at end of file
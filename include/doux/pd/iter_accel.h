@@ -0,0 +1,151 @@
+//******************************************************************************
+// iter_accel.h -- This file is part of Doux, a realtime softbody simulation library
+//
+// Copyright (C) 2021 Changxi Zheng <cxz@cs.columbia.edu>
+//
+// This Source Code Form is subject to the terms of the Mozilla Public License
+// v. 2.0. If a copy of the MPL was not distributed with this file, You can
+// obtain one at http://mozilla.org/MPL/2.0/.
+//******************************************************************************
+
+#pragma once
+
+/*
+ * This header defines the methods to accelerate the local/global iterations
+ * of projective dynamics. They operate on the stacked positions of the free
+ * vertices (i.e., GlobalSolver::solution()) right after each global solve.
+ */
+
+#include <variant>
+#include "doux/core/platform.h"
+#include "doux/linalg/num_types.h"
+
+NAMESPACE_BEGIN(doux::pd)
+
+/*
+ * Chebyshev semi-iterative acceleration (see [Wang 2015]):
+ *
+ *   q^{k+1} = \omega_{k+1} (\gamma (\hat{q}^{k+1} - q^k) + q^k - q^{k-1}) + q^{k-1}
+ *
+ * where \hat{q}^{k+1} is the result of the k-th local/global iteration.
+ *
+ * [Wang 2015] Wang, H., 2015. A chebyshev semi-iterative approach for accelerating
+ * projective and position-based dynamics. ACM Transactions on Graphics (TOG),
+ * 34(6), pp.1-9.
+ */
+class ChebyshevAccel {
+ public:
+  ChebyshevAccel() = default;
+
+  /*
+   * rho:    estimated spectral radius of the plain iterations. If it is not
+   *         positive, it is measured from the plain iterations of the first
+   *         `warmup` timesteps.
+   * gamma:  under-relaxation factor
+   * delay:  number of plain iterations in every timestep before the
+   *         acceleration starts
+   */
+  explicit ChebyshevAccel(real_t rho, real_t gamma = 0.9,
+                          uint32_t delay = 5, uint32_t warmup = 1) :
+      rho_{rho}, gamma_{gamma}, delay_{delay},
+      warmup_{rho > 0 ? 0 : warmup} {
+    assert(rho < 1 && gamma > 0 && gamma <= 1);
+  }
+
+  // return the (estimated) spectral radius
+  [[nodiscard]] DOUX_ALWAYS_INLINE real_t rho() const noexcept { return rho_; }
+
+  // return true if rho is still being measured
+  [[nodiscard]] DOUX_ALWAYS_INLINE bool warming_up() const noexcept { return warmup_ > 0; }
+
+  // Called before the iterations of each timestep
+  // x: the initial iterate (i.e., the predicted positions)
+  void begin(const linalg::matrix_x4_r_t& x);
+
+  // Called after each global solve to update x in place
+  void update(linalg::matrix_x4_r_t& x);
+
+  // Called after the iterations of each timestep
+  void end();
+
+ private:
+  real_t   rho_ {0};
+  real_t   gamma_ {0.9};
+  uint32_t delay_ {5};
+  uint32_t warmup_ {1}; // number of remaining warm-up timesteps
+
+  uint32_t k_ {0};      // iteration count in the current timestep
+  real_t   omega_ {1};
+
+  real_t   diff_ {0};      // ||q^k - q^{k-1}|| (only used in warm-up)
+  real_t   rho_meas_ {0};  // spectral radius measured in the current timestep
+
+  linalg::matrix_x4_r_t q_prev_;   // q^{k-1}
+  linalg::matrix_x4_r_t q_curr_;   // q^k
+};
+
+/*
+ * Anderson acceleration (see [Peng 2018]), which treats one local/global 
+ * iteration as a fixed-point map q^{k+1} = G(q^k), and extrapolates from the 
+ * last m iterates. 
+ *
+ * To safeguard the convergence, the PD energy at an extrapolated iterate is 
+ * compared to the energy at the previous iterate (see accept()). If it 
+ * increases, the extrapolation is discarded and the iterations fall back to 
+ * the plain iterate G(q^k).
+ *
+ * [Peng 2018] Peng, Y., Deng, B., Zhang, J., Geng, F., Qin, W. and Liu, L., 2018. 
+ * Anderson acceleration for geometry optimization and physics simulation. 
+ * ACM Transactions on Graphics (TOG), 37(4), pp.1-14.
+ */
+class AndersonAccel {
+ public:
+  // m: history depth, i.e., the number of previous iterates used in extrapolation
+  explicit AndersonAccel(uint32_t m = 5) : m_{m} { assert(m > 0); }
+
+  [[nodiscard]] DOUX_ALWAYS_INLINE uint32_t depth() const noexcept { return m_; }
+
+  // return the number of extrapolated iterates rejected by the energy check
+  // since the construction
+  [[nodiscard]] DOUX_ALWAYS_INLINE size_t num_rejected() const noexcept { return num_rejected_; }
+
+  // Called before the iterations of each timestep
+  // x: the initial iterate (i.e., the predicted positions)
+  void begin(const linalg::matrix_x4_r_t& x);
+
+  /*
+   * Called after the local step with the energy e evaluated at the current 
+   * iterate. Return false if the current iterate is extrapolated and increases
+   * the energy. In that case, the caller should restore the iterate returned 
+   * by fallback() and redo the local step.
+   */
+  [[nodiscard]] bool accept(real_t e);
+
+  // Return the plain iterate G(q^{k-1}) to replace the rejected one, and 
+  // clear the history
+  [[nodiscard]] const linalg::matrix_x4_r_t& fallback();
+
+  // Called after each global solve: x = G(q^k) is replaced by the 
+  // extrapolated iterate in place
+  void update(linalg::matrix_x4_r_t& x);
+
+ private:
+  uint32_t m_;
+  uint32_t nhist_ {0};  // number of columns in dg_ and df_
+  uint32_t col_ {0};    // the column to be overwritten next in dg_ and df_
+  bool     has_prev_ {false};
+  bool     extrapolated_ {false};  // indicate if q_ is an extrapolated iterate
+  real_t   e_prev_ {0};
+  size_t   num_rejected_ {0};
+
+  linalg::matrix_x4_r_t q_;      // current iterate q^k
+  linalg::matrix_x4_r_t g_prev_; // G(q^{k-1})
+  linalg::vector_r_t f_prev_; // G(q^{k-1}) - q^{k-1}
+  linalg::matrix_r_t dg_;     // differences of G, one column for each iteration
+  linalg::matrix_r_t df_;     // differences of the residuals
+};
+
+// The acceleration used in the local/global iterations of ProjDynSim
+using IterAccel = std::variant<std::monostate, ChebyshevAccel, AndersonAccel>;
+
+NAMESPACE_END(doux::pd)
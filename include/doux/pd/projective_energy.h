@@ -55,6 +55,32 @@ class ProjEnergy {
   virtual void register_global_solve_elems(GlobalSolver* solver) = 0;
   // update the RHS in global system
   virtual void update_global_solve_rhs(GlobalSolver* solver) = 0;
+  /*
+   * Add w A_i^T A_i p to q in the matrix-free product q = A p, using
+   * GlobalSolver::mat_vec_in() and GlobalSolver::mat_vec_out()
+   */
+  virtual void apply_global_solve_mat(GlobalSolver* solver) const = 0;
+
+  /*
+   * The RHS terms of an energy can be written as S_i p_i, where the rows of 
+   * p_i are its projection (e.g., the columns of the projected rotation), 
+   * and S_i is constant. An energy supporting it returns the number of rows
+   * of p_i, and the global solver assembles the S_i of all energies into one
+   * sparse matrix S in init(), so b = b0 + S p is a single SpMV. Otherwise 
+   * (0 rows), the RHS is scattered by update_global_solve_rhs().
+   */
+  [[nodiscard]] virtual uint32_t num_proj_rows() const { return 0; }
+  // add the elements of S_i using GlobalSolver::add_rhs_elem()
+  virtual void register_global_solve_rhs(GlobalSolver* /*solver*/) const {}
+  // store the rows of p_i, as (x, y, z, 0), into P.row(row), P.row(row+1), ...
+  virtual void store_proj_rows(linalg::matrix_x4_r_t& /*P*/, size_t /*row*/) const {}
+
+  /*
+   * Return true if the term is stored in an energy batch of its softbody 
+   * (see ProjEnergyBatch), which runs the local step and the RHS gather of 
+   * all its terms.
+   */
+  [[nodiscard]] virtual bool batched() const { return false; }
 
  protected:
   ProjDynBody*  body_;
@@ -62,6 +88,41 @@ class ProjEnergy {
   real_t stiffness_ {1};
 };
 
+/*
+ * Abstract class for the energy terms of one type on a softbody, stored 
+ * together (e.g., as structure of arrays), so that their local step and 
+ * RHS gather are processed in batch. Each batch is created by 
+ * ProjDynBody::energy_batch() when its first term is added.
+ */
+class ProjEnergyBatch {
+ public:
+  virtual ~ProjEnergyBatch() {}
+
+  [[nodiscard]] virtual ProjEnergyType type() const = 0;
+  // return the number of energy terms
+  [[nodiscard]] virtual size_t size() const = 0;
+
+  // the local step of the terms [b, e)
+  virtual void project(size_t b, size_t e) = 0;
+
+  // evaluate the energy of the terms [b, e)
+  [[nodiscard]] virtual real_t val(size_t b, size_t e) const = 0;
+
+  // The per-term versions of the ProjEnergy methods, for term t
+  DOUX_ATTR(nonnull) virtual void register_global_solve_elems(GlobalSolver* solver, size_t t) const = 0;
+  DOUX_ATTR(nonnull) virtual void update_global_solve_rhs(GlobalSolver* solver, size_t t) const = 0;
+  DOUX_ATTR(nonnull) virtual void apply_global_solve_mat(GlobalSolver* solver, size_t t) const = 0;
+
+  // The RHS terms of term t are S_t p_t (see ProjEnergy::num_proj_rows()). 
+  // The rows of p_t are the num_proj_rows() rows starting from 
+  // t * num_proj_rows() in the batch.
+  [[nodiscard]] virtual uint32_t num_proj_rows() const = 0;
+  // add the elements of all S_t using GlobalSolver::add_rhs_elem()
+  virtual void register_global_solve_rhs(GlobalSolver* solver) const = 0;
+  // store the rows of p_t of the terms [b, e) into P, from P.row(row)
+  virtual void store_proj_rows(linalg::matrix_x4_r_t& P, size_t row, size_t b, size_t e) const = 0;
+};
+
 class PlaneColliEnergy : public ProjEnergy {
  public:
   // The energy type info is needed when grouping energy terms together for 
@@ -76,16 +137,95 @@ class PlaneColliEnergy : public ProjEnergy {
   Vec3r  p_;              // the projected vertex position
 };
 
+/*
+ * Structure-of-arrays storage of the TetCorotEnergy terms of a softbody: 
+ * each per-term quantity (vertex IDs, D^{-1}, rotations, ...) is stored in
+ * contiguous arrays, so the local step and the RHS gather of all terms run
+ * in tight loops without pointer chasing or virtual calls.
+ */
+class TetCorotBatch : public ProjEnergyBatch {
+ public:
+  static constexpr ProjEnergyType Type = ProjEnergyType::TET_ASAP;
+
+  DOUX_ATTR(nonnull) explicit TetCorotBatch(const ProjDynBody* b) noexcept : body_{b} {}
+
+  [[nodiscard]] ProjEnergyType type() const override { return Type; }
+  [[nodiscard]] size_t size() const override { return stiffness_.size(); }
+
+  void project(size_t b, size_t e) override;
+  [[nodiscard]] real_t val(size_t b, size_t e) const override;
+
+  DOUX_ATTR(nonnull) void register_global_solve_elems(GlobalSolver* solver, size_t t) const override;
+  DOUX_ATTR(nonnull) void update_global_solve_rhs(GlobalSolver* solver, size_t t) const override;
+  DOUX_ATTR(nonnull) void apply_global_solve_mat(GlobalSolver* solver, size_t t) const override;
+
+  // p_t: the 3 columns of the projected rotation, minus the terms of the 
+  // restricted vertices
+  [[nodiscard]] uint32_t num_proj_rows() const override { return 3; }
+  DOUX_ATTR(nonnull) void register_global_solve_rhs(GlobalSolver* solver) const override;
+  void store_proj_rows(linalg::matrix_x4_r_t& P, size_t row, size_t b, size_t e) const override;
+
+  // append a term, and return its index
+  uint32_t add(real_t stiff, size_t v0, size_t v1, size_t v2, size_t v3);
+
+  // Number of the iterations to extract the rotations, warm-started from the
+  // ones of the previous projection. With 0 (default), the rotations are 
+  // computed from scratch by the polar decomposition.
+  void set_rot_iters(uint32_t n);
+  [[nodiscard]] DOUX_ALWAYS_INLINE uint32_t rot_iters() const { return rot_iters_; }
+
+  // ------------------------------------------------
+  // data of term t
+
+  [[nodiscard]] DOUX_ALWAYS_INLINE size_t vtx(size_t t, int j) const { return v_[j][t]; }
+
+  [[nodiscard]] DOUX_ALWAYS_INLINE 
+  bool restricted(size_t t, int j) const { return (restricted_[t] >> j) & 1; }
+
+  [[nodiscard]] DOUX_ALWAYS_INLINE real_t stiffness(size_t t) const { return stiffness_[t]; }
+
+  // c_j: coefficients of vertex j in the deformation gradient, such that
+  // F = \sum_j x_j c_j^T
+  [[nodiscard]] DOUX_ALWAYS_INLINE linalg::vec3_r_t coeff(size_t t, int j) const {
+    return j == 0 ? linalg::vec3_r_t(-d_sum_[0][t], -d_sum_[1][t], -d_sum_[2][t]) :
+        linalg::vec3_r_t(D_inv_[j-1][t], D_inv_[j+2][t], D_inv_[j+5][t]);
+  }
+
+  // the projected rotation
+  [[nodiscard]] linalg::mat3_r_t rot(size_t t) const;
+
+  // the projected rotation, with the terms of the restricted vertices moved
+  // to the RHS
+  [[nodiscard]] linalg::mat3_r_t rhs_proj(size_t t) const;
+
+ private:
+  const ProjDynBody* body_;
+
+  // entry t of each array belongs to term t
+  std::vector<uint32_t> v_[4];        // vertex IDs
+  std::vector<uint8_t>  restricted_;  // bit j: vertex j is restricted
+  std::vector<real_t>   stiffness_;
+  std::vector<real_t>   D_inv_[9];    // D^{-1} to compute the def. gradient (column-major)
+  std::vector<real_t>   d_sum_[3];    // column sums of D^{-1}
+  std::vector<real_t>   r_[9];        // projected def. gradient, a rotation (column-major)
+  std::vector<real_t>   q_[4];        // r_ as a quaternion (w, x, y, z), if rot_iters_ > 0
+
+  uint32_t rot_iters_{0};
+};
+
 /*
  * Simple Corotationa energy for a tet
- * 
- * WithFixedVtx_: indicate if this energy term involves fixed vertices
+ *
+ * The term is stored in the TetCorotBatch of its softbody, and this class 
+ * is only a handle referring to it by its index (see 
+ * ProjDynBody::add_energy()), whose methods run the ones of the batch.
  */
 class TetCorotEnergy : public ProjEnergy {
  public:
   // The energy type info is needed when grouping energy terms together for 
   // batch processing on GPUs
   static constexpr ProjEnergyType Type = ProjEnergyType::TET_ASAP;
+  using Batch = TetCorotBatch;
 
   // ------------------------------------------------
   TetCorotEnergy() = delete;
@@ -101,19 +241,131 @@ class TetCorotEnergy : public ProjEnergy {
   // evaluate the energy value
   [[nodiscard]] real_t val() const override;
 
+  // project this term only (ProjDynBody::project() projects the whole batch)
   void project() override;
   DOUX_ATTR(nonnull) void register_global_solve_elems(GlobalSolver* solver) override;
   // update the RHS in global system
   DOUX_ATTR(nonnull) void update_global_solve_rhs(GlobalSolver* solver) override;
+  DOUX_ATTR(nonnull) void apply_global_solve_mat(GlobalSolver* solver) const override;
+
+  [[nodiscard]] bool batched() const override { return true; }
+
+  // return the index of the term in the batch
+  [[nodiscard]] DOUX_ALWAYS_INLINE uint32_t index() const { return idx_; }
+
+ private:
+  TetCorotBatch* batch_;
+  uint32_t       idx_;
+};
+
+/*
+ * Structure-of-arrays storage of the TriCorotEnergy terms of a softbody, 
+ * similar to TetCorotBatch. The deformation gradient of a triangle is a 3x2 
+ * matrix F = (x1-x0, x2-x0) D^{-1}, where D holds the rest edges in the 2D 
+ * frame of the triangle, and it is projected to the closest 3x2 matrix with
+ * orthonormal columns.
+ */
+class TriCorotBatch : public ProjEnergyBatch {
+ public:
+  static constexpr ProjEnergyType Type = ProjEnergyType::TRI_ASAP;
+
+  DOUX_ATTR(nonnull) explicit TriCorotBatch(const ProjDynBody* b) noexcept : body_{b} {}
+
+  [[nodiscard]] ProjEnergyType type() const override { return Type; }
+  [[nodiscard]] size_t size() const override { return stiffness_.size(); }
+
+  void project(size_t b, size_t e) override;
+  [[nodiscard]] real_t val(size_t b, size_t e) const override;
+
+  DOUX_ATTR(nonnull) void register_global_solve_elems(GlobalSolver* solver, size_t t) const override;
+  DOUX_ATTR(nonnull) void update_global_solve_rhs(GlobalSolver* solver, size_t t) const override;
+  DOUX_ATTR(nonnull) void apply_global_solve_mat(GlobalSolver* solver, size_t t) const override;
+
+  // p_t: the 2 columns of the projection, minus the terms of the restricted 
+  // vertices
+  [[nodiscard]] uint32_t num_proj_rows() const override { return 2; }
+  DOUX_ATTR(nonnull) void register_global_solve_rhs(GlobalSolver* solver) const override;
+  void store_proj_rows(linalg::matrix_x4_r_t& P, size_t row, size_t b, size_t e) const override;
+
+  // append a term, and return its index
+  uint32_t add(real_t stiff, size_t v0, size_t v1, size_t v2);
+
+  // ------------------------------------------------
+  // data of term t
+
+  [[nodiscard]] DOUX_ALWAYS_INLINE size_t vtx(size_t t, int j) const { return v_[j][t]; }
+
+  [[nodiscard]] DOUX_ALWAYS_INLINE 
+  bool restricted(size_t t, int j) const { return (restricted_[t] >> j) & 1; }
+
+  [[nodiscard]] DOUX_ALWAYS_INLINE real_t stiffness(size_t t) const { return stiffness_[t]; }
+
+  // c_j: coefficients of vertex j in the deformation gradient, such that
+  // F = \sum_j x_j c_j^T
+  [[nodiscard]] DOUX_ALWAYS_INLINE linalg::vec2_r_t coeff(size_t t, int j) const {
+    return j == 0 ? linalg::vec2_r_t(-d_sum_[0][t], -d_sum_[1][t]) :
+        linalg::vec2_r_t(D_inv_[j-1][t], D_inv_[j+1][t]);
+  }
+
+  // the projected deformation gradient
+  [[nodiscard]] Eigen::Matrix<real_t, 3, 2> rot(size_t t) const;
+
+  // the projected deformation gradient, with the terms of the restricted 
+  // vertices moved to the RHS
+  [[nodiscard]] Eigen::Matrix<real_t, 3, 2> rhs_proj(size_t t) const;
 
  private:
-  size_t v_[4];
-  bool restricted_vtx_[4];
+  const ProjDynBody* body_;
 
-  // D^{-1} to compute the deformation gradient
-  linalg::mat3_r_t D_inv_;
-  linalg::vec3_r_t d_sum_;
-  linalg::mat3_r_t r_;      // projected def. gradient (should be a rotational matrix)
+  // entry t of each array belongs to term t
+  std::vector<uint32_t> v_[3];        // vertex IDs
+  std::vector<uint8_t>  restricted_;  // bit j: vertex j is restricted
+  std::vector<real_t>   stiffness_;
+  std::vector<real_t>   D_inv_[4];    // D^{-1} in the rest frame (column-major)
+  std::vector<real_t>   d_sum_[2];    // column sums of D^{-1}
+  std::vector<real_t>   r_[6];        // projected def. gradient (column-major)
+};
+
+/*
+ * Corotational (as-rigid-as-possible) energy of a triangle, e.g., for cloth
+ *
+ * The term is stored in the TriCorotBatch of its softbody, and this class 
+ * is only a handle referring to it by its index, like TetCorotEnergy.
+ */
+class TriCorotEnergy : public ProjEnergy {
+ public:
+  static constexpr ProjEnergyType Type = ProjEnergyType::TRI_ASAP;
+  using Batch = TriCorotBatch;
+
+  // ------------------------------------------------
+  TriCorotEnergy() = delete;
+  TriCorotEnergy(const TriCorotEnergy&) = default;
+  TriCorotEnergy(TriCorotEnergy&&) = default;
+  TriCorotEnergy& operator = (const TriCorotEnergy&) = default;
+  TriCorotEnergy& operator = (TriCorotEnergy&&) = default;
+
+  TriCorotEnergy(ProjDynBody* b, real_t s, size_t v0, size_t v1, size_t v2);
+
+  // ------------------------------------------------
+
+  // evaluate the energy value
+  [[nodiscard]] real_t val() const override;
+
+  // project this term only (ProjDynBody::project() projects the whole batch)
+  void project() override;
+  DOUX_ATTR(nonnull) void register_global_solve_elems(GlobalSolver* solver) override;
+  // update the RHS in global system
+  DOUX_ATTR(nonnull) void update_global_solve_rhs(GlobalSolver* solver) override;
+  DOUX_ATTR(nonnull) void apply_global_solve_mat(GlobalSolver* solver) const override;
+
+  [[nodiscard]] bool batched() const override { return true; }
+
+  // return the index of the term in the batch
+  [[nodiscard]] DOUX_ALWAYS_INLINE uint32_t index() const { return idx_; }
+
+ private:
+  TriCorotBatch* batch_;
+  uint32_t       idx_;
 };
 
 NAMESPACE_END(doux::pd)
\ No newline at end of file
@@ -22,6 +22,8 @@
 
 NAMESPACE_BEGIN(doux::pd)
 
+class EnvColliConsBuilder;
+
 //
 // CD_: class for collision dection. If CD_ = std::monostate, no collision detection 
 //      will be performed.
@@ -29,7 +31,7 @@ template <class CD_ = std::monostate>
 class PBDScene {
  public:
    [[nodiscard]] DOUX_ALWAYS_INLINE 
-   std::vector<MotiveBody>& deformables() { return sb_; }
+   std::vector<PBDBody>& deformables() { return sb_; }
 
    /// detect the collisions in the current scene
    /// and update the collison constraints
@@ -57,7 +59,7 @@ class PBDScene {
 template <class CD_ = std::monostate>
 class ProjDynScene {
  public:
-  ProjDynBody(std::vector<ProjDynBody>&& b);
+  explicit ProjDynScene(std::vector<ProjDynBody>&& b) : sb_{std::move(b)} {}
 
    [[nodiscard]] DOUX_ALWAYS_INLINE 
    std::vector<ProjDynBody>& deformables() { return sb_; }
@@ -65,8 +67,16 @@ class ProjDynScene {
    [[nodiscard]] DOUX_ALWAYS_INLINE 
    const std::vector<ProjDynBody>& deformables() const { return sb_; }
 
+   /// detect the collisions in the current scene
+   /// and update the collison energy terms
+   void update_colli_cons() {
+     if constexpr (!std::is_same_v<CD_, std::monostate>) {
+       UNIMPLEMENTED
+     }
+   }
+
    [[nodiscard]] DOUX_ALWAYS_INLINE
-   const std::vector<std::unique_ptr<CFunc>>& collision_constraints() const {
+   const std::vector<std::unique_ptr<ProjEnergy>>& collision_constraints() const {
      return colli_cons_;
    }
 
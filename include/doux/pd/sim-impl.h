@@ -80,29 +80,64 @@ size_t ProjDynSim<Scene_, GlobalSolver_, ExtForce_, DataProc_>::step() {
   scene_.update_colli_cons(); // update collision constraints
 
   auto& cons = scene_.collision_constraints();
+  solver_.update_colli_terms(cons);
 
   // load position data in a single vector
-  solver_.begin_iter(bodies, cons);
-  for(auto i = 0;i < status_.num_iter;++ i) {
+  solver_.begin_iter(bodies);
+  auto* cheby = std::get_if<ChebyshevAccel>(&accel_);
+  if ( cheby ) cheby->begin(solver_.solution());
+  auto* anderson = std::get_if<AndersonAccel>(&accel_);
+  if ( anderson ) anderson->begin(solver_.solution());
+
+  // PD energy of the current iterate (scaled by dt^2 like the global system),
+  // from the sum of the terms computed by the local step
+  auto const energy = [&](real_t e) {
+    return solver_.inertia_energy() + e * status_.dt2;
+  };
+
+  size_t iter = 0;
+  real_t dx0 = 0;  // norm of the first update, for the convergence check
+  while ( iter < status_.num_iter ) {
     // --- local solve ---
-    // TODO: parallelize it
-    for(auto& sb : bodies) { sb.project(); }
-    for(auto& cf : cons) { cf->project(); }
+    // the Anderson safeguard needs the energy, which is summed by the local 
+    // step while the terms are in cache
+    auto const e = local_step(cons, anderson != nullptr);
+
+    // safeguard Anderson acceleration: if the extrapolated iterate increases
+    // the energy, fall back to the plain iterate
+    if ( anderson && !anderson->accept(energy(e)) ) [[unlikely]] {
+      solver_.solution() = anderson->fallback();
+      solver_.store_pos(bodies);
+      [[maybe_unused]] auto const ok = anderson->accept(energy(local_step(cons, true)));
+      assert(ok);
+    }
 
     // --- global solve ---
     solver_.begin_solve();
     // populate the RHS vector b
-    // TODO: parallelize
-    for(auto const& sb : bodies) {
-      for(auto const& e : sb.internal_energies()) {
-        e->update_global_solver_rhs(&solver);
-      }
-    }
-    for(auto& cf : cons) { cf->update_global_solver_rhs(&solver); }
+    solver_.assemble_rhs(cons);
     // solve Ax = b
+    if ( status_.tol > 0 ) x_prev_ = solver_.solution();
     solver_.solve();
+    if ( cheby ) cheby->update(solver_.solution());
+    if ( anderson ) anderson->update(solver_.solution());
     solver_.store_pos(bodies);
+    ++ iter;
+
+    // stop early if the positions hardly change, compared to the first 
+    // update of the step (i.e., independent of where the bodies are), or 
+    // the change is only rounding noise, which grows with ||x||
+    if ( status_.tol > 0 ) {
+      auto const x = solver_.solution().template leftCols<3>();
+      real_t const dx = (x - x_prev_.template leftCols<3>()).norm();
+      if ( iter == 1 ) dx0 = dx;
+      real_t const floor = SimStats::ROUNDING_FLOOR * 
+                           std::numeric_limits<real_t>::epsilon() * x.norm();
+      if ( iter >= status_.min_iter && dx <= std::max(status_.tol * dx0, floor) ) break;
+    }
   } // end subiter
+  if ( cheby ) cheby->end();
+  status_.record_iter(iter);
 
   // update vel. and pos
   for(auto& sb : bodies) {
@@ -114,4 +149,70 @@ size_t ProjDynSim<Scene_, GlobalSolver_, ExtForce_, DataProc_>::step() {
   }
 
   return status_.finished_steps;
-}
\ No newline at end of file
+}
+
+template <class Scene_, class GlobalSolver_, class ExtForce_, class DataProc_> 
+void ProjDynSim<Scene_, GlobalSolver_, ExtForce_, DataProc_>::init_local_step() {
+  // The chunks only depend on the energy terms, not on the number of threads,
+  // so each term is always projected in the same chunk, and the results are 
+  // deterministic.
+  for(auto const& sb : scene_.deformables()) {
+    for(auto const& b : sb.energy_batches()) {
+      auto const n = static_cast<uint32_t>(b->size());
+      for(uint32_t i = 0;i < n;i += LOCAL_GRAIN) {
+        local_chunks_.push_back({b.get(), i, std::min(i + LOCAL_GRAIN, n)});
+      }
+    }
+    for(auto const& e : sb.internal_energies()) unbatched_.push_back(e.get());
+  }
+  auto const n = static_cast<uint32_t>(unbatched_.size());
+  for(uint32_t i = 0;i < n;i += LOCAL_GRAIN) {
+    local_chunks_.push_back({nullptr, i, std::min(i + LOCAL_GRAIN, n)});
+  }
+}
+
+template <class Scene_, class GlobalSolver_, class ExtForce_, class DataProc_> 
+template <class Cons_>
+real_t ProjDynSim<Scene_, GlobalSolver_, ExtForce_, DataProc_>::local_step(
+    const Cons_& cons, bool with_energy) {
+  // the chunks are distributed dynamically over the threads of the pool; 
+  // the energy of each chunk is stored separately and summed in the chunk 
+  // order, so the sum does not depend on the scheduling
+  auto const nc = local_chunks_.size();
+  auto const nk = (cons.size() + LOCAL_GRAIN - 1) / LOCAL_GRAIN;
+  if ( with_energy ) local_energy_.assign(nc + nk, 0);
+
+  parallel_for(nc, 1, [this, with_energy](size_t b, size_t e) {
+    for(size_t i = b;i < e;++ i) {
+      auto const& c = local_chunks_[i];
+      if ( c.batch ) {
+        c.batch->project(c.b, c.e);
+        if ( with_energy ) local_energy_[i] = c.batch->val(c.b, c.e);
+      } else {
+        real_t v = 0;
+        for(uint32_t k = c.b;k < c.e;++ k) {
+          unbatched_[k]->project();
+          if ( with_energy ) v += unbatched_[k]->val();
+        }
+        if ( with_energy ) local_energy_[i] = v;
+      }
+    }
+  });
+  parallel_for(nk, 1, [this, &cons, nc, with_energy](size_t b, size_t e) {
+    for(size_t i = b;i < e;++ i) {
+      auto const k1 = std::min((i + 1) * LOCAL_GRAIN, cons.size());
+      real_t v = 0;
+      for(size_t k = i * LOCAL_GRAIN;k < k1;++ k) {
+        cons[k]->project();
+        if ( with_energy ) v += cons[k]->val();
+      }
+      if ( with_energy ) local_energy_[nc + i] = v;
+    }
+  });
+
+  real_t e = 0;
+  if ( with_energy ) {
+    for(auto const v : local_energy_) e += v;
+  }
+  return e;
+}
@@ -15,6 +15,9 @@
  */
 
 #include "doux/doux.h"
+#include "doux/core/parallel.h"
+#include "projective_energy.h"
+#include "iter_accel.h"
 
 NAMESPACE_BEGIN(doux::pd)
 
@@ -22,18 +25,43 @@ struct SimStats {
   /// finished number of steps
   size_t finished_steps {0};
 
-  /// number of solver iterations
+  /// (maximum) number of solver iterations in each step
   size_t num_iter;
 
+  /// If positive, the iterations of a step stop early once the change of 
+  /// the stacked positions, relative to the first change of the step, 
+  /// ||x^{k+1} - x^k|| / ||x^1 - x^0||, drops below tol. It does not depend 
+  /// on the location of the bodies. The iterations also stop once the change 
+  /// is at the rounding level of the positions, ROUNDING_FLOOR * eps * ||x||.
+  /// If tol is not positive, num_iter iterations are always used.
+  real_t tol {0};
+
+  /// rounding noise of the positions, relative to eps * ||x||, below which 
+  /// the iterations are considered converged (used if tol > 0)
+  static constexpr real_t ROUNDING_FLOOR = 4;
+
+  /// minimum number of solver iterations in each step (used if tol > 0)
+  size_t min_iter {1};
+
+  /// number of iterations used in the last step
+  size_t last_iter {0};
+
+  /// total number of iterations used in all finished steps
+  size_t total_iter {0};
+
   /// physical timestep size
   real_t dt;
   real_t dt2; // dt^2
 
+  /// elapsed simulation time, accumulated over the steps, so it stays 
+  /// continuous if dt changes
+  real_t time {0};
+
   // ----------------------------------------------------------
 
   SimStats() = delete;
 
-  SimStats(const SimStats&) = delete;
+  SimStats(const SimStats&) = default;
   SimStats(SimStats&&) = delete;
   SimStats& operator=(const SimStats&) = delete;
   SimStats& operator=(SimStats&&) = delete;
@@ -42,13 +70,27 @@ struct SimStats {
     assert(dt > 0 && niter > 0);
   }
 
+  /// Iterate until converged to the tolerance tol, using between
+  /// min_iter and max_iter iterations in each step
+  SimStats(real_t dt, size_t max_iter, real_t tol, size_t min_iter = 1) : 
+      num_iter{max_iter}, tol{tol}, min_iter{min_iter}, dt{dt}, dt2{dt*dt} {
+    assert(dt > 0 && max_iter > 0 && tol > 0 && min_iter <= max_iter);
+  }
+
   /// Return the current simulation time
   [[nodiscard]] DOUX_ALWAYS_INLINE real_t t() const noexcept {
-    return dt * finished_steps;
+    return time;
   }
 
   DOUX_ALWAYS_INLINE void step() {
     ++ finished_steps;
+    time += dt;
+  }
+
+  /// Record the number of iterations used in the current step
+  DOUX_ALWAYS_INLINE void record_iter(size_t niter) {
+    last_iter = niter;
+    total_iter += niter;
   }
 };
 
@@ -95,6 +137,8 @@ class ProjDynSim {
       status_{s}, scene_{std::forward<Scene_>(scene)},
       solver_{std::forward<GlobalSolver_>(solver)} {
     solver_.init(scene_.deformables(), status_.dt2);
+    solver_.bind_pos(scene_.deformables());
+    init_local_step();
   }
 
   // Construct with external force and without data processing
@@ -104,16 +148,69 @@ class ProjDynSim {
       solver_{std::forward<GlobalSolver_>(solver)},
       ext_f_{std::forward<ExtForce_>(f)} {
     solver_.init(scene_.deformables(), status_.dt2);
+    solver_.bind_pos(scene_.deformables());
+    init_local_step();
   }
+
+  ProjDynSim(const ProjDynSim&) = delete;
+  ProjDynSim(ProjDynSim&&) = default;
+  ProjDynSim& operator = (const ProjDynSim&) = delete;
+  ProjDynSim& operator = (ProjDynSim&&) = default;
+
+  // the softbodies keep their positions in the solver (see GlobalSolver::bind_pos())
+  ~ProjDynSim() { solver_.unbind_pos(scene_.deformables()); }
       
 
   /// Timestep the simulation
   size_t step();
 
+  /// Set the method to accelerate the local/global iterations 
+  /// (std::monostate: plain iterations)
+  void set_iter_accel(IterAccel accel) { accel_ = std::move(accel); }
+
+  [[nodiscard]] DOUX_ALWAYS_INLINE const IterAccel& iter_accel() const { return accel_; }
+
+  /// Change the timestep. The global solver keeps its symbolic analysis, and 
+  /// only recomputes its numeric factorization.
+  void set_timestep(real_t dt) {
+    assert(dt > 0);
+    status_.dt  = dt;
+    status_.dt2 = dt * dt;
+    solver_.refactor(status_.dt2);
+  }
+
+  [[nodiscard]] DOUX_ALWAYS_INLINE const SimStats& stats() const { return status_; }
+
+  [[nodiscard]] DOUX_ALWAYS_INLINE const Scene_& scene() const { return scene_; }
+
  private:
+  // split the internal energy terms into the chunks of the local step
+  void init_local_step();
+  // the local step: project all energy terms in parallel; if with_energy is
+  // set, return the sum of their energies after the projection (otherwise 0)
+  template <class Cons_>
+  real_t local_step(const Cons_& cons, bool with_energy = false);
+
+  // number of terms in a chunk of the local step, a multiple of the SIMD 
+  // lanes of the energy batches
+  static constexpr uint32_t LOCAL_GRAIN = 256;
+
+  // a chunk [b, e) of the terms of a batch, or of unbatched_ if batch is null
+  struct LocalChunk {
+    ProjEnergyBatch* batch;
+    uint32_t b, e;
+  };
+
   SimStats      status_;
   Scene_        scene_;   // simulation scene
   GlobalSolver_ solver_;
+  IterAccel     accel_;
+
+  std::vector<LocalChunk>  local_chunks_;
+  std::vector<ProjEnergy*> unbatched_;  // the internal terms without a batch
+  std::vector<real_t>      local_energy_; // energy of each local step chunk
+
+  linalg::matrix_x4_r_t x_prev_; // previous iterate for the convergence check
 
   ExtForce_   ext_f_;       // external force
   DataProc_   data_proc_;
@@ -16,6 +16,8 @@
 
 #include <vector>
 #include <span>
+#include <memory>
+#include <functional>
 #include "doux/core/platform.h"
 #include "doux/core/svec.h"
 #include "doux/linalg/num_types.h"
@@ -116,7 +118,8 @@ class MotiveBody : public Softbody {
   template<typename POS_, typename FS_>
   MotiveBody(POS_&& pos, FS_&& fs) : 
       Softbody{std::forward<POS_>(pos), std::forward<FS_>(fs)},
-      num_free_{pos_.size()}, pred_pos_{pos_.size()} {}
+      num_free_{pos_.size()}, pred_pos_{pos_}, 
+      pred_free_{pred_pos_.data() + num_restricted_} {}
 
   // This constructor will be called by `build_softbody` in motion_preset.h
   template<typename POS_, typename FS_>
@@ -127,7 +130,7 @@ class MotiveBody : public Softbody {
       num_fixed_{nfixed}, num_restricted_{nfixed + p0.size()},
       num_free_{pos_.size() - num_restricted_},
       p0_{std::move(p0)}, script_{std::move(script)}, 
-      pred_pos_{pos_.size()} {
+      pred_pos_{pos_}, pred_free_{pred_pos_.data() + num_restricted_} {
     assert(p0_.size() == script_.size() && num_restricted_ <= pos_.size());
   }
 
@@ -178,6 +181,13 @@ class MotiveBody : public Softbody {
   [[nodiscard]] DOUX_ALWAYS_INLINE 
   auto const& init_scripted_pos() const { return p0_; }
 
+  // return the predicted (i.e., currently iterated) position of a vertex
+  [[nodiscard]] DOUX_ALWAYS_INLINE 
+  auto const& pred_pos(size_t vid) const { 
+    assert(vid < pred_pos_.size());
+    return vid < num_restricted_ ? pred_pos_[vid] : pred_free_[vid - num_restricted_]; 
+  }
+
   // Explicitly update vel. and pos. by a uniform acceleration 
   // v += a*dt
   // p += v*dt
@@ -206,23 +216,60 @@ class MotiveBody : public Softbody {
   std::vector<Vec3r>      p0_;      // initial positions of scripted vertices
   std::vector<MotionFunc> script_;  // scripted vertex motion, one for each scripted vertex
   std::vector<Vec3r>      pred_pos_;// to store predicted vertex positions
+  // predicted positions of the free vertices: either the tail of pred_pos_, 
+  // or the rows of the global solver (see GlobalSolver::bind_pos())
+  Vec3r*                  pred_free_ {nullptr};
 };
 
 // -----------------------------------------------------------------------
 
 class GlobalSolver;  // linear solver for the global step
 class ProjEnergy;
+class ProjEnergyBatch;
+enum struct ProjEnergyType : uint32_t;
 
 class ProjDynBody : public MotiveBody {
  friend class GlobalSolver;
 
  public:
+  using MotiveBody::MotiveBody;
+
+  // create an internal energy term of type E_ on this softbody
+  // E_'s constructor takes the softbody pointer as its first argument.
+  // A term of a batched type (with E_::Batch) is only stored in its batch, 
+  // and a handle to it is returned by value. The other terms are stored in 
+  // the softbody, and returned by reference.
+  template <class E_, typename... Args>
+  decltype(auto) add_energy(Args&&... args) {
+    if constexpr (requires { typename E_::Batch; }) {
+      return E_(this, std::forward<Args>(args)...);
+    } else {
+      auto& e = e_.emplace_back(std::make_unique<E_>(this, std::forward<Args>(args)...));
+      return static_cast<E_&>(*e);
+    }
+  }
+
+  // return the batch of the energy type B_ (e.g., TetCorotBatch), which is
+  // created on first use by the batched energy terms
+  template <class B_>
+  B_& energy_batch() {
+    if ( auto* b = find_batch(B_::Type) ) return static_cast<B_&>(*b);
+    return static_cast<B_&>(add_batch(std::make_unique<B_>(this)));
+  }
+
+  [[nodiscard]] DOUX_ALWAYS_INLINE 
+  const std::vector<std::unique_ptr<ProjEnergyBatch>>& energy_batches() const { return batches_; }
+
   // the project (local solve) step
   // This method apply the local solve step on all internal energy terms of the softbody
   void project();
 
+  // evaluate the energy of all internal energy terms
+  [[nodiscard]] real_t energy() const;
+
   [[nodiscard]] DOUX_ALWAYS_INLINE uint32_t id() const { return id_; }
 
+  // return the internal energy terms not stored in a batch
   [[nodiscard]] DOUX_ALWAYS_INLINE 
   const std::vector<std::unique_ptr<ProjEnergy>>& internal_energies() const { return e_; } 
 
@@ -230,9 +277,14 @@ class ProjDynBody : public MotiveBody {
   // the ID will be set by `Glb`
   void set_id(uint32_t id) noexcept { id_ = id; }
 
+  [[nodiscard]] ProjEnergyBatch* find_batch(ProjEnergyType type) const;
+  ProjEnergyBatch& add_batch(std::unique_ptr<ProjEnergyBatch> b);
+
  private:
   uint32_t id_;
-  // the softbody's implicit energy terms
+  // the softbody's implicit energy terms: the terms of the batched types are
+  // stored in their batches, and the others are stored one by one
+  std::vector<std::unique_ptr<ProjEnergyBatch>> batches_;
   std::vector<std::unique_ptr<ProjEnergy>> e_; 
 };
 
@@ -0,0 +1,177 @@
+//******************************************************************************
+// parallel.cpp -- This file is part of Doux, a realtime softbody simulation library
+//
+// Copyright (C) 2021 Changxi Zheng <cxz@cs.columbia.edu>
+//
+// This Source Code Form is subject to the terms of the Mozilla Public License
+// v. 2.0. If a copy of the MPL was not distributed with this file, You can
+// obtain one at http://mozilla.org/MPL/2.0/.
+//******************************************************************************
+
+#include <algorithm>
+#include <cassert>
+#include <utility>
+#include "doux/core/parallel.h"
+
+NAMESPACE_BEGIN(doux)
+
+thread_local bool ThreadPool::in_pool_ = false;
+
+static DOUX_ALWAYS_INLINE uint64_t pack_range(size_t b, size_t e) {
+  return (static_cast<uint64_t>(b) << 32) | static_cast<uint64_t>(e);
+}
+
+ThreadPool::ThreadPool(size_t nthreads) {
+  if ( nthreads == 0 ) {
+    nthreads = std::max(std::thread::hardware_concurrency(), 1U);
+  }
+  slots_ = std::make_unique<Slot[]>(nthreads);
+  workers_.reserve(nthreads - 1);
+  for(size_t i = 1;i < nthreads;++ i) {
+    workers_.emplace_back([this, i] { worker_loop(i); });
+  }
+}
+
+ThreadPool::~ThreadPool() {
+  {
+    std::lock_guard lk(mtx_);
+    stop_ = true;
+  }
+  job_cv_.notify_all();
+  for(auto& t : workers_) t.join();
+}
+
+void ThreadPool::run(size_t n, size_t grain, ChunkFunc f, void* data) {
+  std::lock_guard run_lk(run_mtx_);
+  {
+    // a worker waking up late may still be visiting the previous job
+    std::unique_lock lk(mtx_);
+    done_cv_.wait(lk, [this] { return active_ == 0; });
+    func_ = f;
+    data_ = data;
+    n_ = n;
+    grain_ = grain;
+    num_chunks_ = (n + grain - 1) / grain;
+    assert(num_chunks_ < (uint64_t(1) << 32));
+    // split the chunks evenly, the threads balance them by stealing
+    auto const nt = num_threads();
+    for(size_t t = 0;t < nt;++ t) {
+      slots_[t].range.store(pack_range(t * num_chunks_ / nt, (t + 1) * num_chunks_ / nt),
+                            std::memory_order_relaxed);
+    }
+    pending_.store(num_chunks_, std::memory_order_relaxed);
+    failed_.store(false, std::memory_order_relaxed);
+    error_ = nullptr;
+    ++ gen_;
+  }
+  job_cv_.notify_all();
+
+  {
+    // the calling thread runs chunks as well
+    struct InPool {
+      InPool() { in_pool_ = true; }
+      ~InPool() { in_pool_ = false; }
+    } in_pool;
+    work(0);
+  }
+
+  std::unique_lock lk(mtx_);
+  done_cv_.wait(lk, [this] {
+    return active_ == 0 && pending_.load(std::memory_order_acquire) == 0;
+  });
+  // no chunk refers to f or data anymore, so the exception can leave the job
+  if ( error_ ) std::rethrow_exception(std::exchange(error_, nullptr));
+}
+
+void ThreadPool::work(size_t slot) {
+  size_t c;
+  while ( pop(slot, c) || steal(slot, c) ) {
+    // after a failure, the remaining chunks are only counted as finished
+    if ( !failed_.load(std::memory_order_relaxed) ) {
+      auto const b = c * grain_;
+      try {
+        func_(data_, b, std::min(b + grain_, n_));
+      } catch (...) {
+        std::lock_guard lk(mtx_);
+        if ( !error_ ) error_ = std::current_exception();
+        failed_.store(true, std::memory_order_relaxed);
+      }
+    }
+    pending_.fetch_sub(1, std::memory_order_acq_rel);
+  }
+}
+
+bool ThreadPool::pop(size_t slot, size_t& c) {
+  auto& r = slots_[slot].range;
+  auto v = r.load(std::memory_order_acquire);
+  for(;;) {
+    auto const b = v >> 32, e = v & 0xFFFFFFFF;
+    if ( b >= e ) return false;
+    if ( r.compare_exchange_weak(v, pack_range(b + 1, e), std::memory_order_acq_rel) ) {
+      c = b;
+      return true;
+    }
+  }
+}
+
+bool ThreadPool::steal(size_t slot, size_t& c) {
+  // A range is fully described by its value, so a thief that compares 
+  // against an outdated value can only take chunks that are still there.
+  auto const nt = num_threads();
+  for(size_t k = 1;k < nt;++ k) {
+    auto& r = slots_[(slot + k) % nt].range;
+    auto v = r.load(std::memory_order_acquire);
+    for(;;) {
+      auto const b = v >> 32, e = v & 0xFFFFFFFF;
+      if ( b >= e ) break;
+      auto const mid = b + (e - b) / 2;
+      if ( r.compare_exchange_weak(v, pack_range(b, mid), std::memory_order_acq_rel) ) {
+        // the own range is empty, so no other thread has changed it
+        slots_[slot].range.store(pack_range(mid + 1, e), std::memory_order_release);
+        c = mid;
+        return true;
+      }
+    }
+  }
+  return false;
+}
+
+void ThreadPool::worker_loop(size_t slot) {
+  in_pool_ = true;
+  uint64_t seen = 0;
+  for(;;) {
+    {
+      std::unique_lock lk(mtx_);
+      job_cv_.wait(lk, [&] { return stop_ || gen_ != seen; });
+      if ( stop_ ) return;
+      seen = gen_;
+      ++ active_;
+    }
+
+    work(slot);
+
+    {
+      std::lock_guard lk(mtx_);
+      -- active_;
+    }
+    done_cv_.notify_one();
+  }
+}
+
+static std::unique_ptr<ThreadPool>& global_pool() {
+  static std::unique_ptr<ThreadPool> pool = std::make_unique<ThreadPool>();
+  return pool;
+}
+
+ThreadPool& thread_pool() {
+  return *global_pool();
+}
+
+void set_num_threads(size_t nthreads) {
+  auto& pool = global_pool();
+  // join the old workers before starting the new ones
+  pool.reset();
+  pool = std::make_unique<ThreadPool>(nthreads);
+}
+
+NAMESPACE_END(doux)
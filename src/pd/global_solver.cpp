@@ -10,6 +10,12 @@
 
 #include "doux/pd/global_solver.h"
 #include "doux/pd/projective_energy.h"
+#include "doux/core/parallel.h"
+#include <algorithm>
+#include <utility>
+#include <cmath>
+#include <limits>
+#include <numeric>
 
 // References:
 //
@@ -19,6 +25,48 @@
 //
 NAMESPACE_BEGIN(doux::pd)
 
+/*
+ * Solve L D L^T z = y in place for a (permuted) RHS y, whose rows are 
+ * (x, y, z, 0). The triangular solves traverse the factor L once, and apply
+ * each of its entries to a whole row.
+ */
+template <typename T_>
+static void ldlt_substitute(
+    const Eigen::SimplicialLDLT<Eigen::SparseMatrix<T_>, Eigen::Lower>& ldlt,
+    Eigen::Matrix<T_, Eigen::Dynamic, 4, Eigen::RowMajor>& y) {
+  using row_t = Eigen::Matrix<T_, 1, 4>;
+
+  // L is stored in the compressed column format, excluding its unit diagonal
+  auto const& L = ldlt.matrixL().nestedExpression();
+  const auto* Lp = L.outerIndexPtr();
+  const auto* Li = L.innerIndexPtr();
+  const T_*   Lx = L.valuePtr();
+  auto const& D = ldlt.vectorD();
+  auto const  n = L.outerSize();
+
+  // L y = P b
+  for(Eigen::Index j = 0;j < n;++ j) {
+    const row_t yj = y.row(j);
+    for(auto k = Lp[j];k < Lp[j+1];++ k) {
+      y.row(Li[k]) -= Lx[k] * yj;
+    }
+  }
+  // D z = y
+  for(Eigen::Index j = 0;j < n;++ j) {
+    y.row(j) /= D(j);
+  }
+  // L^T w = z
+  for(Eigen::Index j = n-1;j >= 0;-- j) {
+    row_t yj = y.row(j);
+    for(auto k = Lp[j];k < Lp[j+1];++ k) {
+      yj -= Lx[k] * y.row(Li[k]);
+    }
+    y.row(j) = yj;
+  }
+}
+
+// ------------------------------------------------------------------------
+
 void GlobalSolver::init(std::vector<ProjDynBody>& sb, real_t dt2) {
   dt2_ = dt2;
 
@@ -34,34 +82,1336 @@ void GlobalSolver::init(std::vector<ProjDynBody>& sb, real_t dt2) {
 
   // allocate memory
   diag_.resize(N);	// method from Eigen
-  b_.resize(N);
-  x_.resize(N);
-  b0_.resize(N);
-  off_diag_map_.resize(N);
-  
-  // fill diagonal & off-diagonal elements in A
+  b_.setZero(N, 4);
+  x_.setZero(N, 4);
+  b0_.setZero(N, 4);
+
+  // diagonal elements has mass
+  mass_.resize(N);
   id = 0;
   for(auto const& b : sb) {
-    // diagonal elements has mass
     auto const& mass = b.mass();
-    assert(body_vec_map_[id] + b.num_free_vs() <= diag_.size());
-    diag_.segment(body_vec_map_[id ++], b.num_free_vs()) = mass.tail(b.num_free_vs());
+    assert(body_vec_map_[id] + b.num_free_vs() <= static_cast<size_t>(mass_.size()));
+    mass_.segment(body_vec_map_[id ++], b.num_free_vs()) = mass.tail(b.num_free_vs());
+  }
+  // the stiffness part K of A = M + h^2 K is assembled first, and kept apart
+  // from h^2 (see refactor())
+  diag_.setZero();
+
+  // greedy coloring of the energies: take the smallest color not used by 
+  // the (already colored) energies on the same rows, or the last (serial) 
+  // bucket if all colors are used
+  auto const color = [this]<class T_>(std::vector<uint64_t>& row_colors, 
+                                     std::vector<std::vector<T_>>& colors, T_ e) {
+    uint64_t taken = 0;
+    for(auto const v : elem_rows_) taken |= row_colors[v];
+    auto const c = static_cast<uint32_t>(std::countr_one(taken));
+    if ( c < MAX_RHS_COLORS ) {
+      for(auto const v : elem_rows_) row_colors[v] |= uint64_t(1) << c;
+    }
+    if ( colors.size() <= c ) colors.resize(c + 1);
+    colors[c].push_back(e);
+  };
+  // bit c: color c is used on the row, for assemble_rhs() and mat_vec_free()
+  std::vector<uint64_t> row_colors(N, 0), mv_row_colors(matrix_free_ ? N : 0, 0);
+  rhs_colors_.clear();
+  mv_colors_.clear();
+  proj_energies_.clear();
+  // register the elements of all internal energy terms, and color them
+  auto const register_energies = [&](bool colored) {
+    for(auto const& b : sb) {
+      // the batched terms are gathered by their batches
+      for(auto const& pb : b.energy_batches()) {
+        for(size_t t = 0;t < pb->size();++ t) {
+          pb->register_global_solve_elems(this, t);
+          // all energies apply A in the matrix-free mode
+          if ( colored && matrix_free_ ) {
+            color(mv_row_colors, mv_colors_, EnergyTerm{pb.get(), nullptr, static_cast<uint32_t>(t)});
+          }
+          elem_rows_.clear();
+        }
+      }
+      for(auto const& e : b.internal_energies()) {
+        e->register_global_solve_elems(this);
+        if ( colored ) {
+          if ( matrix_free_ ) color(mv_row_colors, mv_colors_, EnergyTerm{nullptr, e.get(), 0});
+          if ( e->num_proj_rows() > 0 ) {
+            // gathered by S instead
+            proj_energies_.push_back(e.get());
+          } else {
+            color(row_colors, rhs_colors_, e.get());
+          }
+        }
+        elem_rows_.clear();
+      }
+    }
+  };
+
+  if ( matrix_free_ ) {
+    // only the diagonal elements are needed (e.g., for preconditioning)
+    off_diag_ptr_.assign(N + 1, 0);
+    off_diag_.clear();
+    stage_ = AssembleStage::DIAG;
+    register_energies(true);
+    k_diag_ = diag_;
+    k_off_.clear();
+    scale_values();
+    init_rhs_op(sb);
+    colli_map_.assign(N, NO_COLLI);
+    colli_vtx_.clear();
+    colli_mat_.resize(0, 0);
+    return;
+  }
+
+  // M + h^2 \sum (w_i A^T A x): Eq.(10) in [1]
+  // 1. symbolic pass: count the off-diagonal elements of each row
+  off_diag_ptr_.assign(N + 1, 0);
+  stage_ = AssembleStage::COUNT;
+  register_energies(true);
+  for(size_t i = 0;i < N;++ i) off_diag_ptr_[i+1] += off_diag_ptr_[i];
 
-    // M + h^2 \sum (w_i A^T A x): Eq.(10) in [1]
-    for(auto const& e : b.internal_energies()) {
-      e->register_global_solve_elems(this);
+  // 2. numeric pass: fill in the diagonal and (possibly duplicated) 
+  //    off-diagonal elements
+  off_diag_.resize(off_diag_ptr_[N]);
+  fill_pos_.assign(off_diag_ptr_.begin(), off_diag_ptr_.end() - 1);
+  stage_ = AssembleStage::FILL;
+  register_energies(false);
+  assert(std::equal(fill_pos_.begin(), fill_pos_.end(), off_diag_ptr_.begin() + 1));
+  std::vector<size_t>().swap(fill_pos_);
+
+  // 3. sort each row by column IDs and merge the duplicated elements in place
+  size_t nnz = 0;
+  for(size_t i = 0;i < N;++ i) {
+    auto const s = off_diag_ptr_[i];
+    auto const t = off_diag_ptr_[i+1];
+    std::sort(off_diag_.begin() + s, off_diag_.begin() + t, 
+              [](const MatElem& a, const MatElem& b) { return a.cid < b.cid; });
+
+    off_diag_ptr_[i] = nnz;
+    for(size_t j = s;j < t;++ j) {
+      if ( nnz > off_diag_ptr_[i] && off_diag_[nnz-1].cid == off_diag_[j].cid ) {
+        off_diag_[nnz-1].val += off_diag_[j].val;
+      } else {
+        off_diag_[nnz ++] = off_diag_[j];
+      }
+    }
+  }
+  off_diag_ptr_[N] = nnz;
+  off_diag_.resize(nnz);
+  off_diag_.shrink_to_fit();
+
+  k_diag_ = diag_;
+  k_off_.resize(nnz);
+  for(size_t i = 0;i < nnz;++ i) k_off_[i] = off_diag_[i].val;
+  scale_values();
+  init_rhs_op(sb);
+
+  colli_map_.assign(N, NO_COLLI);
+  colli_vtx_.clear();
+  colli_mat_.resize(0, 0);
+}
+
+void GlobalSolver::scale_values() {
+  diag_backup_ = mass_ + dt2_ * k_diag_;
+  diag_ = diag_backup_;
+  for(size_t i = 0;i < k_off_.size();++ i) off_diag_[i].val = dt2_ * k_off_[i];
+}
+
+void GlobalSolver::refactor(real_t dt2) {
+  assert(dt2 > 0);
+  auto const s = dt2 / dt2_;
+  dt2_ = dt2;
+  scale_values();
+  // the collision terms are rescaled as well, until they are updated in 
+  // the next timestep
+  colli_mat_ *= s;
+  for(auto& e : colli_elems_) std::get<2>(e) *= s;
+
+  factorize_numeric();
+  update_colli_mat();
+}
+
+void GlobalSolver::init_rhs_op(const std::vector<ProjDynBody>& sb) {
+  rhs_elems_.clear();
+  proj_batches_.clear();
+  proj_batch_row_.clear();
+  size_t nrows = 0;
+  for(auto const& b : sb) {
+    for(auto const& pb : b.energy_batches()) {
+      proj_batches_.push_back(pb.get());
+      proj_batch_row_.push_back(nrows);
+      proj_row_ = nrows;
+      pb->register_global_solve_rhs(this);
+      nrows += pb->size() * pb->num_proj_rows();
     }
-  } // end for
+  }
+
+  proj_ptr_.resize(proj_energies_.size() + 1);
+  proj_ptr_[0] = nrows;
+  for(size_t i = 0;i < proj_energies_.size();++ i) {
+    proj_row_ = proj_ptr_[i];
+    proj_energies_[i]->register_global_solve_rhs(this);
+    proj_ptr_[i+1] = proj_ptr_[i] + proj_energies_[i]->num_proj_rows();
+  }
 
-  diag_backup_ = diag_;
-  // now convert the map into a plain vector
-  off_diag_.resize(N);
+  rhs_op_.resize(size(), proj_ptr_.back());
+  rhs_op_.setFromTriplets(rhs_elems_.begin(), rhs_elems_.end());
+  std::vector<Eigen::Triplet<real_t>>().swap(rhs_elems_);
+  proj_.setZero(proj_ptr_.back(), 4);
+}
+
+void GlobalSolver::assemble_rhs(const std::vector<std::unique_ptr<ProjEnergy>>& cons) {
+  constexpr size_t GRAIN = 256;
+
+  // 1. b += h^2 S P: the energies write disjoint rows of P, and S is 
+  //    applied with streaming reads of its rows
+  for(size_t k = 0;k < proj_batches_.size();++ k) {
+    auto const* pb  = proj_batches_[k];
+    auto const  row = proj_batch_row_[k];
+    auto const  np  = pb->num_proj_rows();
+    parallel_for(pb->size(), GRAIN, [&](size_t b, size_t e) {
+      pb->store_proj_rows(proj_, row + b * np, b, e);
+    });
+  }
+  parallel_for(proj_energies_.size(), GRAIN, [this](size_t b, size_t e) {
+    for(size_t k = b;k < e;++ k) proj_energies_[k]->store_proj_rows(proj_, proj_ptr_[k]);
+  });
+  parallel_for(size(), GRAIN, [this](size_t b, size_t e) {
+    const auto* ptr = rhs_op_.outerIndexPtr();
+    const auto* idx = rhs_op_.innerIndexPtr();
+    const auto* val = rhs_op_.valuePtr();
+    for(size_t i = b;i < e;++ i) {
+      linalg::row4_r_t r = linalg::row4_r_t::Zero();
+      for(auto k = ptr[i];k < ptr[i+1];++ k) r += val[k] * proj_.row(idx[k]);
+      b_.row(i) += r * dt2_;
+    }
+  });
+
+  // 2. the other energies scatter into b
+
+  for(size_t c = 0;c < rhs_colors_.size();++ c) {
+    auto const& es = rhs_colors_[c];
+    if ( c == MAX_RHS_COLORS ) [[unlikely]] {
+      for(auto* e : es) e->update_global_solve_rhs(this);
+      break;
+    }
+    parallel_for(es.size(), GRAIN, [&](size_t b, size_t e) {
+      for(size_t k = b;k < e;++ k) es[k]->update_global_solve_rhs(this);
+    });
+  }
+  // few collision energies, which may share vertices with each other
+  for(auto const& e : cons) e->update_global_solve_rhs(this);
+}
+
+void GlobalSolver::update_colli_terms(const std::vector<std::unique_ptr<ProjEnergy>>& cons) {
+  // nothing changes if there were and are no collisions
+  if ( cons.empty() && colli_vtx_.empty() ) return;
+
+  for(auto const v : colli_vtx_) colli_map_[v] = NO_COLLI;
+  colli_vtx_.clear();
+  colli_elems_.clear();
+
+  stage_ = AssembleStage::COLLI;
+  for(auto const& cf : cons) {
+    cf->register_global_solve_elems(this);
+  }
+
+  auto const k = static_cast<Eigen::Index>(colli_vtx_.size());
+  colli_mat_.setZero(k, k);
+  for(auto const& [i, j, v] : colli_elems_) colli_mat_(i, j) += v;
+
+  update_colli_mat();
+}
+
+void GlobalSolver::update_colli_mat() {
+  // check before changing any state
+  if ( std::any_of(colli_elems_.begin(), colli_elems_.end(), 
+                   [](auto const& e) { return std::get<0>(e) != std::get<1>(e); }) ) {
+    throw std::runtime_error("The global solver does not support collision terms coupling different vertices");
+  }
+  diag_ = diag_backup_;
+  for(size_t i = 0;i < colli_vtx_.size();++ i) {
+    diag_(colli_vtx_[i]) += colli_mat_(i, i);
+  }
+}
+
+void GlobalSolver::mat_vec_free(const linalg::matrix_x4_r_t& p, linalg::matrix_x4_r_t& q) {
+  assert(matrix_free_);
+  constexpr size_t GRAIN = 256;
+  q = p.array().colwise() * mass_.array();
+  mv_in_ = &p;
+  mv_out_ = &q;
+  // the energies of a color write disjoint rows of q
+  for(size_t c = 0;c < mv_colors_.size();++ c) {
+    auto const& es = mv_colors_[c];
+    auto const apply = [this](const EnergyTerm& et) {
+      if ( et.batch ) {
+        et.batch->apply_global_solve_mat(this, et.t);
+      } else {
+        et.e->apply_global_solve_mat(this);
+      }
+    };
+    if ( c == MAX_RHS_COLORS ) [[unlikely]] {
+      for(auto const& et : es) apply(et);
+      break;
+    }
+    parallel_for(es.size(), GRAIN, [&](size_t b, size_t e) {
+      for(size_t k = b;k < e;++ k) apply(es[k]);
+    });
+  }
+  mv_in_ = nullptr;
+  mv_out_ = nullptr;
+}
+
+void GlobalSolver::mat_vec_csr(const linalg::matrix_x4_r_t& p, linalg::matrix_x4_r_t& q) const {
+  constexpr size_t GRAIN = 256;
+  parallel_for(size(), GRAIN, [&](size_t b, size_t e) {
+    for(size_t i = b;i < e;++ i) {
+      linalg::row4_r_t v = diag_(i) * p.row(i);
+      for(auto const& m : off_diag_row(i)) {
+        v += m.val * p.row(m.cid);
+      }
+      q.row(i) = v;
+    }
+  });
+}
+
+Eigen::SparseMatrix<real_t> GlobalSolver::system_matrix(bool with_colli) const {
+  const auto N = static_cast<Eigen::Index>(diag_backup_.size());
+
+  std::vector<Eigen::Index> nnz(N);
+  for(Eigen::Index i = 0;i < N;++ i) nnz[i] = off_diag_row(i).size() + 1;
+
+  // A is symmetric, so filling row i into column i gives the same matrix
+  Eigen::SparseMatrix<real_t> ret(N, N);
+  ret.reserve(nnz);
+  for(Eigen::Index i = 0;i < N;++ i) {
+    ret.insert(i, i) = diag_backup_(i);
+    for(auto const& e : off_diag_row(i)) {
+      ret.insert(e.cid, i) = e.val;
+    }
+  }
+
+  if ( with_colli ) {
+    for(size_t i = 0;i < colli_vtx_.size();++ i) {
+      for(size_t j = 0;j < colli_vtx_.size();++ j) {
+        if ( colli_mat_(i, j) != 0 ) ret.coeffRef(colli_vtx_[i], colli_vtx_[j]) += colli_mat_(i, j);
+      }
+    }
+  }
+  ret.makeCompressed();
+  return ret;
+}
+
+real_t GlobalSolver::inertia_energy() const {
+  // 1/2 x^T M x - x^T M s_n, where b0_ = M s_n
+  return static_cast<real_t>(0.5) * (x_.array().square().colwise() * mass_.array()).sum()
+       - (x_.array() * b0_.array()).sum();
+}
+
+/*
+ * Load the predicted positions s_n in x_, and compute b0 = M * s_n
+ */
+void GlobalSolver::begin_iter(const std::vector<ProjDynBody>& sb) {
+  for(auto const& b : sb) {
+    auto const  s = body_vec_map_[b.id()];
+    auto const  r = b.num_restricted_vs();
+    auto const& m = b.mass();
+    if ( is_bound(b) ) {
+      // the positions are already in x_, only clear the padding of Vec3r
+      for(size_t i = 0;i < b.num_free_vs();++ i) {
+        x_(s + i, 3) = 0;
+        b0_.row(s + i) = x_.row(s + i) * m(r + i);
+      }
+      continue;
+    }
+    for(size_t i = 0;i < b.num_free_vs();++ i) {
+      auto const& p = b.pred_free_[i];
+      x_.row(s + i) = linalg::row4_r_t(p.x(), p.y(), p.z(), 0);
+      b0_.row(s + i) = x_.row(s + i) * m(r + i);
+    }
+  }
 }
 
 /*
  * Store the solving result in pred_pos_ list of ProjDynBody
  */
 void GlobalSolver::store_pos(std::vector<ProjDynBody>& sb) {
+  for(auto& b : sb) {
+    if ( is_bound(b) ) continue;
+    auto const s = body_vec_map_[b.id()];
+    for(size_t i = 0;i < b.num_free_vs();++ i) {
+      b.pred_free_[i].set(x_(s + i, 0), x_(s + i, 1), x_(s + i, 2));
+    }
+  }
+}
+
+void GlobalSolver::bind_pos(std::vector<ProjDynBody>& sb) {
+  if constexpr (sizeof(Vec3r) == sizeof(linalg::row4_r_t)) {
+    assert(reinterpret_cast<uintptr_t>(x_.data()) % alignof(Vec3r) == 0);
+    for(auto& b : sb) {
+      if ( b.num_free_vs() == 0 || is_bound(b) ) continue;
+      auto const s = body_vec_map_[b.id()];
+      for(size_t i = 0;i < b.num_free_vs();++ i) {
+        auto const& p = b.pred_free_[i];
+        x_.row(s + i) = linalg::row4_r_t(p.x(), p.y(), p.z(), 0);
+      }
+      b.pred_free_ = reinterpret_cast<Vec3r*>(x_.row(s).data());
+    }
+  }
+}
+
+void GlobalSolver::unbind_pos(std::vector<ProjDynBody>& sb) {
+  for(auto& b : sb) {
+    if ( !is_bound(b) ) continue;
+    auto const s = body_vec_map_[b.id()];
+    auto const r = b.num_restricted_vs();
+    for(size_t i = 0;i < b.num_free_vs();++ i) {
+      b.pred_pos_[r + i].set(x_(s + i, 0), x_(s + i, 1), x_(s + i, 2));
+    }
+    b.pred_free_ = b.pred_pos_.data() + r;
+  }
+}
+
+// ------------------------------------------------------------------------
+
+void GlbGaussSeidelSolver::init(std::vector<ProjDynBody>& sb, real_t dt2) {
+  GlobalSolver::init(sb, dt2);
+
+  // greedy coloring: assign each row the smallest color not taken by 
+  // its (already colored) neighbors
+  const size_t N = size();
+  constexpr uint32_t NO_COLOR = std::numeric_limits<uint32_t>::max();
+  std::vector<uint32_t> color(N, NO_COLOR);
+  std::vector<size_t>   mark;   // mark[c] == i+1: color c is taken by a neighbor of row i
+  uint32_t nc = 0;
+  for(size_t i = 0;i < N;++ i) {
+    for(auto const& e : off_diag_row(i)) {
+      if ( color[e.cid] != NO_COLOR ) mark[color[e.cid]] = i + 1;
+    }
+    uint32_t c = 0;
+    while ( c < nc && mark[c] == i + 1 ) ++ c;
+    if ( c == nc ) {
+      ++ nc;
+      mark.push_back(0);
+    }
+    color[i] = c;
+  }
+
+  // bucket the rows by their colors
+  color_ptr_.assign(nc + 1, 0);
+  for(auto const c : color) ++ color_ptr_[c + 1];
+  for(uint32_t c = 0;c < nc;++ c) color_ptr_[c+1] += color_ptr_[c];
+
+  color_rows_.resize(N);
+  std::vector<size_t> pos(color_ptr_.begin(), color_ptr_.end() - 1);
+  for(size_t i = 0;i < N;++ i) color_rows_[pos[color[i]] ++] = static_cast<uint32_t>(i);
+}
+
+void GlbGaussSeidelSolver::solve() {
+  constexpr size_t GRAIN = 256;
+
+  for(uint32_t s = 0;s < nsweeps_;++ s) {
+    for(size_t c = 0;c + 1 < color_ptr_.size();++ c) {
+      const uint32_t* rows = color_rows_.data() + color_ptr_[c];
+      parallel_for(color_ptr_[c+1] - color_ptr_[c], GRAIN, [&](size_t b, size_t e) {
+        for(size_t k = b;k < e;++ k) {
+          auto const i = rows[k];
+          linalg::row4_r_t r = b_.row(i);
+          for(auto const& m : off_diag_row(i)) {
+            r -= m.val * x_.row(m.cid);
+          }
+          x_.row(i) = r * (static_cast<real_t>(1) / diag_(i));
+        }
+      });
+    }
+  } // end for s
+}
+
+// ------------------------------------------------------------------------
+
+void GlbJacobiSolver::init(std::vector<ProjDynBody>& sb, real_t dt2) {
+  GlobalSolver::init(sb, dt2);
+
+  dinv_ = diag_.cwiseInverse();
+  r_.setZero(size(), 4);
+}
+
+void GlbJacobiSolver::update_colli_mat() {
+  diag_ = diag_backup_;
+  for(size_t i = 0;i < colli_vtx_.size();++ i) {
+    diag_(colli_vtx_[i]) += colli_mat_(i, i);
+  }
+  dinv_ = diag_.cwiseInverse();
+
+  // the off-diagonal collision elements, grouped by their collision vertex
+  auto const k = colli_vtx_.size();
+  colli_ptr_.assign(k + 1, 0);
+  for(auto const& [i, j, v] : colli_elems_) {
+    if ( i != j ) ++ colli_ptr_[i+1];
+  }
+  for(size_t i = 0;i < k;++ i) colli_ptr_[i+1] += colli_ptr_[i];
+  colli_off_.resize(colli_ptr_[k]);
+  std::vector<size_t> pos(colli_ptr_.begin(), colli_ptr_.end() - 1);
+  for(auto const& [i, j, v] : colli_elems_) {
+    if ( i != j ) colli_off_[pos[i] ++] = MatElem{colli_vtx_[j], v};
+  }
+}
+
+void GlbJacobiSolver::solve() {
+  constexpr size_t GRAIN = 256;
+
+  for(uint32_t k = 0;k < niters_;++ k) {
+    mat_vec_csr(x_, r_);
+    // each collision vertex adds its couplings to its own row of r
+    parallel_for(colli_vtx_.size(), GRAIN, [this](size_t b, size_t e) {
+      for(size_t i = b;i < e;++ i) {
+        for(size_t m = colli_ptr_[i];m < colli_ptr_[i+1];++ m) {
+          r_.row(colli_vtx_[i]) += colli_off_[m].val * x_.row(colli_off_[m].cid);
+        }
+      }
+    });
+
+    // x += w D^{-1} (b - A x)
+    parallel_for(size(), GRAIN, [this](size_t b, size_t e) {
+      for(size_t i = b;i < e;++ i) {
+        x_.row(i) += (omega_ * dinv_(i)) * (b_.row(i) - r_.row(i));
+      }
+    });
+  }
+}
+
+// ------------------------------------------------------------------------
+
+void GlbPCGSolver::init(std::vector<ProjDynBody>& sb, real_t dt2) {
+  GlobalSolver::init(sb, dt2);
+
+  const size_t N = size();
+  r_.setZero(N, 4);
+  z_.setZero(N, 4);
+  p_.setZero(N, 4);
+  q_.setZero(N, 4);
+  if ( pc_ == Precond::IC0 ) factor_ic0();
+}
+
+void GlbPCGSolver::factorize_numeric() {
+  if ( pc_ == Precond::IC0 ) factor_ic0();
+}
+
+void GlbPCGSolver::factor_ic0() {
+  // copy the strictly lower part of A, whose rows are sorted by column IDs
+  const size_t N = size();
+  ic_ptr_.assign(N + 1, 0);
+  ic_.clear();
+  for(size_t i = 0;i < N;++ i) {
+    for(auto const& m : off_diag_row(i)) {
+      if ( m.cid >= i ) break;
+      ic_.push_back(m);
+    }
+    ic_ptr_[i+1] = ic_.size();
+  }
+
+  // row-wise IC(0): 
+  //   L_ik = (A_ik - \sum_{j<k} L_ij L_kj) / L_kk, L_ii = sqrt(A_ii - \sum_{j<i} L_ij^2)
+  ic_diag_.resize(N);
+  for(size_t i = 0;i < N;++ i) {
+    for(auto t = ic_ptr_[i];t < ic_ptr_[i+1];++ t) {
+      auto const k = ic_[t].cid;
+      // sparse dot product of the rows i and k over the columns j < k
+      real_t s = 0;
+      auto a = ic_ptr_[i], b = ic_ptr_[k];
+      while ( a < t && b < ic_ptr_[k+1] ) {
+        if ( ic_[a].cid == ic_[b].cid ) {
+          s += ic_[a ++].val * ic_[b ++].val;
+        } else if ( ic_[a].cid < ic_[b].cid ) {
+          ++ a;
+        } else {
+          ++ b;
+        }
+      }
+      ic_[t].val = (ic_[t].val - s) / ic_diag_(k);
+    }
+
+    real_t d = diag_backup_(i);
+    for(auto t = ic_ptr_[i];t < ic_ptr_[i+1];++ t) d -= ic_[t].val * ic_[t].val;
+    // the factorization may break down for general SPD matrices; keep the 
+    // original diagonal element in that case
+    ic_diag_(i) = std::sqrt(d > 0 ? d : diag_backup_(i));
+  }
+}
+
+void GlbPCGSolver::update_colli_mat() {
+  diag_ = diag_backup_;
+  for(size_t i = 0;i < colli_vtx_.size();++ i) {
+    diag_(colli_vtx_[i]) += colli_mat_(i, i);
+  }
+}
+
+void GlbPCGSolver::mat_vec(const linalg::matrix_x4_r_t& p, linalg::matrix_x4_r_t& q) {
+  if ( matrix_free_ ) {
+    mat_vec_free(p, q);
+  } else {
+    mat_vec_csr(p, q);
+  }
+
+  // elements of the collision terms (whose diagonal elements are in diag_ 
+  // unless in the matrix-free mode), applied by their nonzeros
+  for(auto const& [i, j, v] : colli_elems_) {
+    if ( i != j || matrix_free_ ) q.row(colli_vtx_[i]) += v * p.row(colli_vtx_[j]);
+  }
+}
+
+void GlbPCGSolver::precond(const linalg::matrix_x4_r_t& r, linalg::matrix_x4_r_t& z) const {
+  const size_t N = size();
+  if ( pc_ == Precond::JACOBI ) {
+    z = r.array().colwise() / diag_.array();
+    return;
+  }
+
+  // L y = r
+  for(size_t i = 0;i < N;++ i) {
+    linalg::row4_r_t v = r.row(i);
+    for(auto t = ic_ptr_[i];t < ic_ptr_[i+1];++ t) {
+      v -= ic_[t].val * z.row(ic_[t].cid);
+    }
+    z.row(i) = v / ic_diag_(i);
+  }
+  // L^T z = y
+  for(size_t i = N;i > 0;-- i) {
+    z.row(i-1) /= ic_diag_(i-1);
+    for(auto t = ic_ptr_[i-1];t < ic_ptr_[i];++ t) {
+      z.row(ic_[t].cid) -= ic_[t].val * z.row(i-1);
+    }
+  }
+}
+
+void GlbPCGSolver::solve() {
+  // column-wise dot products of two N x 4 matrices
+  auto const dot = [](const linalg::matrix_x4_r_t& a, const linalg::matrix_x4_r_t& b) {
+    return linalg::row4_r_t((a.array() * b.array()).colwise().sum());
+  };
+  constexpr real_t TINY = std::numeric_limits<real_t>::min();
+
+  // the iterations start from the current x_
+  mat_vec(x_, q_);
+  r_ = b_ - q_;
+  const linalg::row4_r_t bb = dot(b_, b_);
+  auto const converged = [&]() {
+    const linalg::row4_r_t rr = dot(r_, r_);
+    return (rr.array() <= tol_ * tol_ * bb.array()).all();
+  };
+
+  last_iters_ = 0;
+  if ( converged() ) return;
+
+  precond(r_, z_);
+  p_ = z_;
+  linalg::row4_r_t rz = dot(r_, z_);
+  while ( last_iters_ < max_iter_ ) {
+    ++ last_iters_;
+    mat_vec(p_, q_);
+    // the padding column is always zero, hence the TINY
+    const linalg::row4_r_t alpha = rz.array() / dot(p_, q_).array().max(TINY);
+    x_ += (p_.array().rowwise() * alpha.array()).matrix();
+    r_ -= (q_.array().rowwise() * alpha.array()).matrix();
+    if ( converged() ) break;
+
+    precond(r_, z_);
+    const linalg::row4_r_t rz_new = dot(r_, z_);
+    const linalg::row4_r_t beta = rz_new.array() / rz.array().max(TINY);
+    p_ = z_ + (p_.array().rowwise() * beta.array()).matrix();
+    rz = rz_new;
+  }
+}
+
+// ------------------------------------------------------------------------
+
+void GlbMultigridSolver::init(std::vector<ProjDynBody>& sb, real_t dt2) {
+  GlobalSolver::init(sb, dt2);
+  build_hierarchy();
+}
+
+void GlbMultigridSolver::build_hierarchy() {
+  constexpr size_t   MAX_LEVELS = 16;
+  constexpr uint32_t NONE = std::numeric_limits<uint32_t>::max();
+
+  levels_.clear();
+  levels_.reserve(MAX_LEVELS);
+  levels_.emplace_back().A = system_matrix();
+  for(;;) {
+    auto& fine = levels_.back();
+    const SpMat& A = fine.A;
+    const auto n = A.rows();
+    fine.dinv = A.diagonal().cwiseInverse();
+    if ( n <= static_cast<Eigen::Index>(coarse_size_) || levels_.size() == MAX_LEVELS ) break;
+
+    // 1. aggregation: first group the vertices whose neighbors are all 
+    //    unaggregated, and then attach each remaining vertex to an aggregate
+    //    of its neighbors
+    std::vector<uint32_t> agg(n, NONE);
+    uint32_t nagg = 0;
+    for(Eigen::Index i = 0;i < n;++ i) {
+      bool free = true;
+      for(SpMat::InnerIterator it(A, i);it && free;++ it) free = agg[it.col()] == NONE;
+      if ( !free ) continue;
+      for(SpMat::InnerIterator it(A, i);it;++ it) agg[it.col()] = nagg;
+      ++ nagg;
+    }
+    const std::vector<uint32_t> agg1 = agg;
+    for(Eigen::Index i = 0;i < n;++ i) {
+      if ( agg[i] != NONE ) continue;
+      for(SpMat::InnerIterator it(A, i);it;++ it) {
+        if ( agg1[it.col()] != NONE ) { agg[i] = agg1[it.col()]; break; }
+      }
+      if ( agg[i] == NONE ) agg[i] = nagg ++;
+    }
+    // stop if the coarsening stagnates (e.g., disconnected vertices)
+    if ( nagg * 5 > n * 4 ) break;
+
+    // 2. P = (I - w D^{-1} A) P0, where P0 is the piecewise constant 
+    //    interpolation, and w = 4 / (3 \lambda_max(D^{-1} A))
+    real_t lmax = 0;
+    for(Eigen::Index i = 0;i < n;++ i) {
+      lmax = std::max(lmax, A.row(i).cwiseAbs().sum() * fine.dinv(i));
+    }
+    auto const w = static_cast<real_t>(4) / (static_cast<real_t>(3) * lmax);
+
+    std::vector<Eigen::Triplet<real_t>> trip;
+    trip.reserve(A.nonZeros());
+    for(Eigen::Index i = 0;i < n;++ i) {
+      for(SpMat::InnerIterator it(A, i);it;++ it) {
+        auto v = -w * fine.dinv(i) * it.value();
+        if ( it.col() == i ) v += 1;
+        trip.emplace_back(i, agg[it.col()], v);
+      }
+    }
+    fine.P.resize(n, nagg);
+    fine.P.setFromTriplets(trip.begin(), trip.end());
+    fine.R = fine.P.transpose();
+
+    // 3. Galerkin coarse matrix
+    SpMat Ac = fine.R * fine.A * fine.P;
+    Ac.prune(static_cast<real_t>(0));
+    levels_.emplace_back().A = std::move(Ac);
+  }
+
+  for(size_t l = 1;l < levels_.size();++ l) {
+    auto const n = levels_[l].A.rows();
+    levels_[l].x.setZero(n, 4);
+    levels_[l].b.setZero(n, 4);
+  }
+  for(auto& lv : levels_) lv.r.setZero(lv.A.rows(), 4);
+
+  coarse_ = std::make_unique<Eigen::SimplicialLDLT<Eigen::SparseMatrix<real_t>, Eigen::Lower>>();
+  coarse_->compute(Eigen::SparseMatrix<real_t>(levels_.back().A));
+  if ( coarse_->info() != Eigen::Success ) [[unlikely]] {
+    throw std::runtime_error("GlbMultigridSolver: failed to factorize the coarsest matrix");
+  }
+  prev_colli_.clear();
+}
+
+void GlbMultigridSolver::factorize_numeric() {
+  // the aggregates only depend on the graph of A, but the smoothed 
+  // prolongation and the coarse matrices depend on its values
+  build_hierarchy();
+}
+
+void GlbMultigridSolver::update_colli_mat() {
+  GlobalSolver::update_colli_mat();
+
+  // restore the diagonal of the previous collision vertices, and update 
+  // that of the current ones
+  auto& lv = levels_.front();
+  for(auto const* vs : {&prev_colli_, &colli_vtx_}) {
+    for(auto const v : *vs) {
+      lv.A.coeffRef(v, v) = diag_(v);
+      lv.dinv(v) = static_cast<real_t>(1) / diag_(v);
+    }
+  }
+  prev_colli_ = colli_vtx_;
+
+  // no hierarchy: the direct solver works on the finest level
+  if ( levels_.size() == 1 ) coarse_->factorize(Eigen::SparseMatrix<real_t>(lv.A));
+}
+
+void GlbMultigridSolver::smooth(Level& lv) {
+  for(uint32_t s = 0;s < nsmooth_;++ s) {
+    lv.r.noalias() = lv.b - lv.A * lv.x;
+    constexpr real_t W = static_cast<real_t>(2) / 3;
+    lv.x += W * (lv.r.array().colwise() * lv.dinv.array()).matrix();
+  }
+}
+
+void GlbMultigridSolver::vcycle(size_t l) {
+  auto& lv = levels_[l];
+  if ( l + 1 == levels_.size() ) {
+    lv.x = coarse_->solve(lv.b);
+    return;
+  }
+
+  smooth(lv);
+  lv.r.noalias() = lv.b - lv.A * lv.x;
+
+  auto& cv = levels_[l+1];
+  cv.b.noalias() = lv.R * lv.r;
+  cv.x.setZero();
+  vcycle(l + 1);
+
+  lv.x.noalias() += lv.P * cv.x;
+  smooth(lv);
+}
+
+void GlbMultigridSolver::solve() {
+  // the finest level works on x_ and b_ directly
+  auto& lv = levels_.front();
+  lv.x.swap(x_);
+  lv.b.swap(b_);
+  for(uint32_t c = 0;c < ncycles_;++ c) vcycle(0);
+  lv.x.swap(x_);
+  lv.b.swap(b_);
+}
+
+// ------------------------------------------------------------------------
+
+void GlbCholeskySolver::init(std::vector<ProjDynBody>& sb, real_t dt2) {
+  GlobalSolver::init(sb, dt2);
+
+  const size_t N = size();
+  row_block_.resize(N);
+  loc_.assign(N, NO_COLLI);
+  blocks_.clear();
+  blocks_.reserve(sb.size());
+  for(auto const& b : sb) {
+    if ( b.num_free_vs() == 0 ) continue;
+
+    auto& blk = blocks_.emplace_back();
+    blk.rows.resize(b.num_free_vs());
+    for(size_t i = 0;i < b.num_free_vs();++ i) {
+      blk.rows[i] = body_vec_map_[b.id()] + i;
+      row_block_[blk.rows[i]] = blocks_.size() - 1;
+    }
+    blk.ldlt = std::make_unique<LDLT>();
+  }
+
+  // A only depends on dt2, so the factorization is done once here
+  parallel_for(blocks_.size(), 1, [this](size_t b, size_t e) {
+    for(size_t i = b;i < e;++ i) factorize(blocks_[i], false, true);
+  });
+
+  islands_.clear();
+  active_.clear();
+  for(auto& blk : blocks_) active_.push_back(&blk);
+}
+
+void GlbCholeskySolver::factorize_numeric() {
+  // the pattern of each block is unchanged, so its ordering and the 
+  // structure of its factor are kept
+  parallel_for(blocks_.size(), 1, [this](size_t b, size_t e) {
+    for(size_t i = b;i < e;++ i) factorize(blocks_[i], false, false);
+  });
+  islands_stale_ = true;
+}
+
+void GlbCholeskySolver::factorize(Block& blk, bool with_colli, bool symbolic) {
+  const auto n = static_cast<Eigen::Index>(blk.rows.size());
+  for(Eigen::Index i = 0;i < n;++ i) loc_[blk.rows[i]] = i;
+
+  std::vector<Eigen::Index> nnz(n);
+  for(Eigen::Index i = 0;i < n;++ i) nnz[i] = off_diag_row(blk.rows[i]).size() + 1;
+
+  // A is symmetric, so filling row i into column i gives the same matrix
+  Eigen::SparseMatrix<real_t> A(n, n);
+  A.reserve(nnz);
+  for(Eigen::Index i = 0;i < n;++ i) {
+    auto const r = blk.rows[i];
+    A.insert(i, i) = diag_backup_(r);
+    for(auto const& e : off_diag_row(r)) {
+      assert(loc_[e.cid] != NO_COLLI);
+      A.insert(loc_[e.cid], i) = e.val;
+    }
+  }
+  if ( with_colli ) {
+    for(auto const& [i, j, v] : colli_elems_) {
+      auto const li = loc_[colli_vtx_[i]];
+      if ( li == NO_COLLI ) continue;
+      assert(loc_[colli_vtx_[j]] != NO_COLLI);
+      A.coeffRef(li, loc_[colli_vtx_[j]]) += v;
+    }
+  }
+  A.makeCompressed();
+  for(auto const r : blk.rows) loc_[r] = NO_COLLI;
+
+  if ( symbolic ) blk.ldlt->analyzePattern(A);
+  blk.ldlt->factorize(A);
+  if ( blk.ldlt->info() != Eigen::Success ) [[unlikely]] {
+    throw std::runtime_error("GlbCholeskySolver: failed to factorize the global matrix");
+  }
+  blk.y.resize(n, 4);
+}
+
+void GlbCholeskySolver::update_colli_mat() {
+  // the islands of the last update, to reuse their factors
+  std::vector<Block> prev;
+  prev.swap(islands_);
+  bool const stale = std::exchange(islands_stale_, false);
+  active_.clear();
+  num_factored_ = 0;
+
+  auto const k = static_cast<Eigen::Index>(colli_vtx_.size());
+  if ( k > max_rank_ ) [[unlikely]] {
+    // Too many vertices for the low-rank correction: merge the blocks coupled
+    // by the collision terms into islands (using union-find), and refactor 
+    // them. The other blocks keep their factors.
+    std::vector<uint32_t> parent(blocks_.size());
+    std::iota(parent.begin(), parent.end(), 0);
+    auto const root = [&](uint32_t b) {
+      while ( parent[b] != b ) b = parent[b] = parent[parent[b]];
+      return b;
+    };
+    for(auto const& [i, j, v] : colli_elems_) {
+      if ( i != j ) parent[root(row_block_[colli_vtx_[i]])] = root(row_block_[colli_vtx_[j]]);
+    }
+
+    constexpr uint32_t NONE = std::numeric_limits<uint32_t>::max();
+    std::vector<uint32_t> island(blocks_.size(), NONE);  // root block -> island
+    for(auto const v : colli_vtx_) {
+      auto const r = root(row_block_[v]);
+      if ( island[r] == NONE ) {
+        island[r] = islands_.size();
+        islands_.emplace_back();
+      }
+    }
+    for(size_t b = 0;b < blocks_.size();++ b) {
+      auto const isl = island[root(b)];
+      if ( isl == NONE ) {
+        active_.push_back(&blocks_[b]);
+      } else {
+        auto& rows = islands_[isl].rows;
+        rows.insert(rows.end(), blocks_[b].rows.begin(), blocks_[b].rows.end());
+      }
+    }
+    for(auto const& [i, j, v] : colli_elems_) {
+      auto const ri = colli_vtx_[i], rj = colli_vtx_[j];
+      islands_[island[root(row_block_[ri])]].colli.emplace_back(ri, rj, v);
+    }
+
+    // An island with the same rows and collision pattern as in the last 
+    // update keeps its ordering, and if the values are unchanged too (e.g., 
+    // its bodies are at rest), its factor. The rows of the islands are 
+    // disjoint, so an island is identified by its first row.
+    std::vector<uint32_t> prev_of(size(), NONE);
+    for(size_t p = 0;p < prev.size();++ p) prev_of[prev[p].rows.front()] = p;
+    std::vector<uint8_t> mode(islands_.size());  // 0: keep, 1: numeric, 2: symbolic
+    for(size_t n = 0;n < islands_.size();++ n) {
+      auto& isl = islands_[n];
+      std::sort(isl.colli.begin(), isl.colli.end());
+      auto const p = prev_of[isl.rows.front()];
+      auto const same_pattern = [](auto const& a, auto const& b) {
+        return std::get<0>(a) == std::get<0>(b) && std::get<1>(a) == std::get<1>(b);
+      };
+      if ( p != NONE && prev[p].rows == isl.rows && 
+           std::equal(isl.colli.begin(), isl.colli.end(), 
+                      prev[p].colli.begin(), prev[p].colli.end(), same_pattern) ) {
+        mode[n] = !stale && isl.colli == prev[p].colli ? 0 : 1;
+        isl.ldlt = std::move(prev[p].ldlt);
+        isl.y = std::move(prev[p].y);
+      } else {
+        mode[n] = 2;
+        isl.ldlt = std::make_unique<LDLT>();
+      }
+    }
+
+    num_factored_ = std::count_if(mode.begin(), mode.end(), [](uint8_t m) { return m > 0; });
+
+    // the islands have disjoint rows, so they are refactored in parallel
+    parallel_for(islands_.size(), 1, [this, &mode](size_t b, size_t e) {
+      for(size_t n = b;n < e;++ n) {
+        if ( mode[n] > 0 ) factorize(islands_[n], true, mode[n] == 2);
+      }
+    });
+    for(auto& isl : islands_) active_.push_back(&isl);
+    return;
+  }
+
+  for(auto& blk : blocks_) active_.push_back(&blk);
+  if ( k == 0 ) return;
+
+  // Z = A^{-1} E: column i only has nonzeros in the block of its vertex, so
+  // Z is stored by block, over the rows of the block and the columns of the
+  // collision vertices in it
+  constexpr uint32_t NONE = std::numeric_limits<uint32_t>::max();
+  std::vector<uint32_t> cblk(blocks_.size(), NONE);  // block -> index in colli_blocks_
+  colli_blocks_.clear();
+  for(Eigen::Index i = 0;i < k;++ i) {
+    auto const b = row_block_[colli_vtx_[i]];
+    if ( cblk[b] == NONE ) {
+      cblk[b] = colli_blocks_.size();
+      colli_blocks_.emplace_back().blk = b;
+    }
+    colli_blocks_[cblk[b]].cols.push_back(i);
+  }
+  parallel_for(colli_blocks_.size(), 1, [this](size_t b, size_t e) {
+    for(size_t c = b;c < e;++ c) {
+      auto& cb = colli_blocks_[c];
+      auto const& blk = blocks_[cb.blk];
+      const auto n = static_cast<Eigen::Index>(blk.rows.size());
+      // the rows of a softbody block are contiguous, so a vertex is at its
+      // offset to the first row
+      assert(blk.rows.back() - blk.rows.front() + 1 == blk.rows.size());
+      linalg::matrix_r_t E = linalg::matrix_r_t::Zero(n, cb.cols.size());
+      for(size_t j = 0;j < cb.cols.size();++ j) {
+        E(colli_vtx_[cb.cols[j]] - blk.rows.front(), j) = 1;
+      }
+      cb.Z = blk.ldlt->solve(E);
+      cb.t.resize(cb.cols.size(), 4);
+    }
+  });
+
+  // the capacitance matrix I + C E^T Z: (E^T Z)(m, j) is only nonzero if the
+  // vertices m and j are in the same block, and C is applied by its elements
+  linalg::matrix_r_t EZ = linalg::matrix_r_t::Zero(k, k);
+  for(auto const& cb : colli_blocks_) {
+    auto const row0 = blocks_[cb.blk].rows.front();
+    for(auto const m : cb.cols) {
+      auto const r = colli_vtx_[m] - row0;
+      for(size_t j = 0;j < cb.cols.size();++ j) EZ(m, cb.cols[j]) = cb.Z(r, j);
+    }
+  }
+  linalg::matrix_r_t cap = linalg::matrix_r_t::Identity(k, k);
+  for(auto const& [i, j, v] : colli_elems_) cap.row(i) += v * EZ.row(j);
+  cap_lu_.compute(cap);
+  t_.resize(k, 4);
+}
+
+void GlbCholeskySolver::solve() {
+  parallel_for(active_.size(), 1, [this](size_t b, size_t e) {
+    for(size_t i = b;i < e;++ i) solve_block(*active_[i]);
+  });
+
+  if ( islands_.empty() && !colli_vtx_.empty() ) {
+    // Woodbury correction: x = x0 - Z (I + C E^T Z)^{-1} C E^T x0
+    t_.setZero();
+    for(auto const& [i, j, v] : colli_elems_) t_.row(i) += v * x_.row(colli_vtx_[j]);
+    t_ = cap_lu_.solve(t_);
+    // only the rows of the blocks with collision vertices change
+    parallel_for(colli_blocks_.size(), 1, [this](size_t b, size_t e) {
+      for(size_t c = b;c < e;++ c) {
+        auto& cb = colli_blocks_[c];
+        auto const& rows = blocks_[cb.blk].rows;
+        for(size_t j = 0;j < cb.cols.size();++ j) cb.t.row(j) = t_.row(cb.cols[j]);
+        const linalg::matrix_x4_r_t dx = cb.Z * cb.t;
+        for(size_t r = 0;r < rows.size();++ r) x_.row(rows[r]) -= dx.row(r);
+      }
+    });
+  }
+}
+
+void GlbCholeskySolver::solve_block(Block& blk) {
+  auto& y = blk.y;
+  auto const n = static_cast<Eigen::Index>(blk.rows.size());
+  for(Eigen::Index i = 0;i < n;++ i) y.row(i) = b_.row(blk.rows[i]);
+  y = blk.ldlt->permutationP() * y;
+  ldlt_substitute(*blk.ldlt, y);
+  y = blk.ldlt->permutationPinv() * y;
+  for(Eigen::Index i = 0;i < n;++ i) x_.row(blk.rows[i]) = y.row(i);
+}
+
+// ------------------------------------------------------------------------
+
+void GlbMixedCholeskySolver::init(std::vector<ProjDynBody>& sb, real_t dt2) {
+  GlobalSolver::init(sb, dt2);
+
+  ldlt_ = std::make_unique<Eigen::SimplicialLDLT<Eigen::SparseMatrix<float>, Eigen::Lower>>();
+  const Eigen::SparseMatrix<float> A = system_matrix().cast<float>();
+  ldlt_->analyzePattern(A);
+  factorize();
+  r_.setZero(size(), 4);
+  xd_.setZero(size(), 4);
+}
+
+void GlbMixedCholeskySolver::factorize() {
+  ldlt_->factorize(system_matrix(true).cast<float>());
+  if ( ldlt_->info() != Eigen::Success ) [[unlikely]] {
+    throw std::runtime_error("GlbMixedCholeskySolver: failed to factorize the global matrix");
+  }
+}
+
+void GlbMixedCholeskySolver::update_colli_mat() {
+  GlobalSolver::update_colli_mat();
+  // only the diagonal changes, so the symbolic analysis is kept
+  factorize();
+}
+
+void GlbMixedCholeskySolver::solve() {
+  // x = A^{-1} b in single precision
+  y_ = ldlt_->permutationP() * b_.cast<float>();
+  ldlt_substitute(*ldlt_, y_);
+  y_ = ldlt_->permutationPinv() * y_;
+  xd_ = y_.cast<double>();
+
+  // iterative refinement: x += A^{-1} (b - A x), where x and the residual 
+  // are kept in double, so the refinement is not limited by the precision 
+  // of the factor even if real_t is float
+  constexpr size_t GRAIN = 256;
+  for(uint32_t s = 0;s < nrefine_;++ s) {
+    parallel_for(size(), GRAIN, [this](size_t b, size_t e) {
+      for(size_t i = b;i < e;++ i) {
+        Eigen::RowVector4d v = b_.row(i).cast<double>() - static_cast<double>(diag_(i)) * xd_.row(i);
+        for(auto const& m : off_diag_row(i)) {
+          v -= static_cast<double>(m.val) * xd_.row(m.cid);
+        }
+        r_.row(i) = v;
+      }
+    });
+    y_ = ldlt_->permutationP() * r_.cast<float>();
+    ldlt_substitute(*ldlt_, y_);
+    y_ = ldlt_->permutationPinv() * y_;
+    xd_ += y_.cast<double>();
+  }
+  x_ = xd_.cast<real_t>();
+}
+
+// ------------------------------------------------------------------------
+
+void GlbSchurSolver::init(std::vector<ProjDynBody>& sb, real_t dt2) {
+  GlobalSolver::init(sb, dt2);
+
+  const size_t N = size();
+  const size_t np = std::clamp<size_t>(
+      nparts_ == 0 ? thread_pool().num_threads() : nparts_, 1, std::max<size_t>(N, 1));
+
+  // 1. order the rows of each connected component by a breadth-first search 
+  //    from a pseudo-peripheral row, and cut the order into np parts of 
+  //    equal sizes, so the cuts run along the level sets
+  std::vector<uint32_t> order, queue, mark(N, IFACE);
+  order.reserve(N);
+  uint32_t stamp = 0;
+  auto const bfs = [&](uint32_t s) {
+    queue.clear();
+    queue.push_back(s);
+    mark[s] = stamp;
+    for(size_t h = 0;h < queue.size();++ h) {
+      for(auto const& e : off_diag_row(queue[h])) {
+        if ( mark[e.cid] != stamp ) {
+          mark[e.cid] = stamp;
+          queue.push_back(e.cid);
+        }
+      }
+    }
+    ++ stamp;
+    return queue.back();
+  };
+  std::vector<bool> placed(N, false);
+  for(uint32_t r = 0;r < N;++ r) {
+    if ( placed[r] ) continue;
+    bfs(bfs(r));
+    for(auto const v : queue) placed[v] = true;
+    order.insert(order.end(), queue.begin(), queue.end());
+  }
+  part_.resize(N);
+  for(size_t i = 0;i < N;++ i) part_[order[i]] = i * np / N;
+
+  // 2. the rows coupled to a later part form the interface, so no interior 
+  //    row is coupled to another part
+  std::vector<bool> is_iface(N, false);
+  for(uint32_t r = 0;r < N;++ r) {
+    for(auto const& e : off_diag_row(r)) {
+      if ( part_[e.cid] > part_[r] ) {
+        is_iface[r] = true;
+        break;
+      }
+    }
+  }
+  iface_.clear();
+  loc_.resize(N);
+  parts_.clear();
+  parts_.resize(np);
+  for(uint32_t r = 0;r < N;++ r) {
+    if ( is_iface[r] ) {
+      part_[r] = IFACE;
+      loc_[r] = iface_.size();
+      iface_.push_back(r);
+    } else {
+      auto& rows = parts_[part_[r]].rows;
+      loc_[r] = rows.size();
+      rows.push_back(r);
+    }
+  }
+  std::erase_if(parts_, [](const Part& p) { return p.rows.empty(); });
+
+  // 3. the coupling block of each part
+  std::vector<uint32_t> iloc(iface_.size(), IFACE);  // interface row -> index in a part
+  for(uint32_t pi = 0;pi < parts_.size();++ pi) {
+    auto& p = parts_[pi];
+    for(auto const r : p.rows) part_[r] = pi;
+
+    std::vector<Eigen::Triplet<real_t>> trips;
+    for(uint32_t i = 0;i < p.rows.size();++ i) {
+      for(auto const& e : off_diag_row(p.rows[i])) {
+        if ( part_[e.cid] != IFACE ) {
+          p.ccol.push_back(IFACE);
+          continue;
+        }
+        auto const j = loc_[e.cid];
+        if ( iloc[j] == IFACE ) {
+          iloc[j] = p.iface.size();
+          p.iface.push_back(j);
+        }
+        p.ccol.push_back(iloc[j]);
+        trips.emplace_back(i, iloc[j], e.val);
+      }
+    }
+    for(auto const j : p.iface) iloc[j] = IFACE;
+
+    p.C.resize(p.rows.size(), p.iface.size());
+    p.C.setFromTriplets(trips.begin(), trips.end());
+    p.ldlt = std::make_unique<LDLT>();
+    p.y.resize(p.rows.size(), 4);
+    p.t.resize(p.iface.size(), 4);
+  }
+  g_.resize(iface_.size(), 4);
+  S_ldlt_ = std::make_unique<LDLT>();
+
+  parallel_for(parts_.size(), 1, [this](size_t b, size_t e) {
+    for(size_t i = b;i < e;++ i) factorize_part(parts_[i], true);
+  });
+  factorize_schur(true);
+  prev_colli_.clear();
+}
+
+void GlbSchurSolver::factorize_part(Part& p, bool symbolic) {
+  const auto n = static_cast<Eigen::Index>(p.rows.size());
+  std::vector<Eigen::Index> nnz(n);
+  for(Eigen::Index i = 0;i < n;++ i) nnz[i] = off_diag_row(p.rows[i]).size() + 1;
+
+  // A is symmetric, so filling row i into column i gives the same matrix
+  Eigen::SparseMatrix<real_t> A(n, n);
+  A.reserve(nnz);
+  for(Eigen::Index i = 0;i < n;++ i) {
+    auto const r = p.rows[i];
+    A.insert(i, i) = diag_(r);
+    for(auto const& e : off_diag_row(r)) {
+      if ( part_[e.cid] != IFACE ) A.insert(loc_[e.cid], i) = e.val;
+    }
+  }
+  A.makeCompressed();
+
+  // the values of the coupling block change with the timestep
+  if ( !symbolic ) {
+    size_t k = 0;
+    for(Eigen::Index i = 0;i < n;++ i) {
+      for(auto const& e : off_diag_row(p.rows[i])) {
+        auto const j = p.ccol[k ++];
+        if ( j != IFACE ) p.C.coeffRef(i, j) = e.val;
+      }
+    }
+  }
+
+  if ( symbolic ) p.ldlt->analyzePattern(A);
+  p.ldlt->factorize(A);
+  if ( p.ldlt->info() != Eigen::Success ) [[unlikely]] {
+    throw std::runtime_error("GlbSchurSolver: failed to factorize the global matrix");
+  }
+  p.W = p.ldlt->solve(linalg::matrix_r_t(p.C));
+  p.T.noalias() = p.C.transpose() * p.W;
+}
+
+void GlbSchurSolver::factorize_schur(bool symbolic) {
+  const auto m = static_cast<Eigen::Index>(iface_.size());
+  if ( m == 0 ) return;
+
+  // The entries of S are A_GG and the (dense) blocks T of the parts, so its
+  // pattern does not change, and the duplicates are summed up. Only the 
+  // lower triangle is kept for the LDLT.
+  std::vector<Eigen::Triplet<real_t>> trips;
+  for(Eigen::Index j = 0;j < m;++ j) {
+    auto const r = iface_[j];
+    trips.emplace_back(j, j, diag_(r));
+    for(auto const& e : off_diag_row(r)) {
+      if ( part_[e.cid] == IFACE && loc_[e.cid] > j ) trips.emplace_back(loc_[e.cid], j, e.val);
+    }
+  }
+  for(auto const& p : parts_) {
+    for(size_t b = 0;b < p.iface.size();++ b) {
+      for(size_t a = 0;a < p.iface.size();++ a) {
+        if ( p.iface[a] >= p.iface[b] ) trips.emplace_back(p.iface[a], p.iface[b], -p.T(a, b));
+      }
+    }
+  }
+  S_.resize(m, m);
+  S_.setFromTriplets(trips.begin(), trips.end());
+
+  if ( symbolic ) S_ldlt_->analyzePattern(S_);
+  S_ldlt_->factorize(S_);
+  if ( S_ldlt_->info() != Eigen::Success ) [[unlikely]] {
+    throw std::runtime_error("GlbSchurSolver: failed to factorize the Schur complement");
+  }
+}
+
+void GlbSchurSolver::factorize_numeric() {
+  parallel_for(parts_.size(), 1, [this](size_t b, size_t e) {
+    for(size_t i = b;i < e;++ i) factorize_part(parts_[i], false);
+  });
+  factorize_schur(false);
+}
+
+void GlbSchurSolver::update_colli_mat() {
+  GlobalSolver::update_colli_mat();
+  if ( colli_vtx_.empty() && prev_colli_.empty() ) return;
+
+  // refactor the parts whose diagonal changed
+  std::vector<uint8_t> dirty(parts_.size(), 0);
+  for(auto const* vs : {&prev_colli_, &colli_vtx_}) {
+    for(auto const v : *vs) {
+      if ( part_[v] != IFACE ) dirty[part_[v]] = 1;
+    }
+  }
+  parallel_for(parts_.size(), 1, [&](size_t b, size_t e) {
+    for(size_t i = b;i < e;++ i) {
+      if ( dirty[i] ) factorize_part(parts_[i], false);
+    }
+  });
+  factorize_schur(false);
+  prev_colli_ = colli_vtx_;
+}
+
+void GlbSchurSolver::solve() {
+  // 1. y_p = A_pp^{-1} b_p, and its coupling to the interface C^T y_p
+  parallel_for(parts_.size(), 1, [this](size_t b, size_t e) {
+    for(size_t i = b;i < e;++ i) {
+      auto& p = parts_[i];
+      auto& y = p.y;
+      for(size_t k = 0;k < p.rows.size();++ k) y.row(k) = b_.row(p.rows[k]);
+      y = p.ldlt->permutationP() * y;
+      ldlt_substitute(*p.ldlt, y);
+      y = p.ldlt->permutationPinv() * y;
+      p.t.noalias() = p.C.transpose() * y;
+    }
+  });
+
+  // 2. S x_G = b_G - \sum C^T y_p
+  //    It stays serial: the substitution is a chain over the rows of S, 
+  //    which are much fewer than the interior rows solved in 1. and 3.
+  for(size_t j = 0;j < iface_.size();++ j) g_.row(j) = b_.row(iface_[j]);
+  for(auto const& p : parts_) {
+    for(size_t a = 0;a < p.iface.size();++ a) g_.row(p.iface[a]) -= p.t.row(a);
+  }
+  if ( !iface_.empty() ) {
+    g_ = S_ldlt_->permutationP() * g_;
+    ldlt_substitute(*S_ldlt_, g_);
+    g_ = S_ldlt_->permutationPinv() * g_;
+  }
+  for(size_t j = 0;j < iface_.size();++ j) x_.row(iface_[j]) = g_.row(j);
+
+  // 3. x_p = y_p - W x_G
+  parallel_for(parts_.size(), 1, [this](size_t b, size_t e) {
+    for(size_t i = b;i < e;++ i) {
+      auto& p = parts_[i];
+      for(size_t a = 0;a < p.iface.size();++ a) p.t.row(a) = g_.row(p.iface[a]);
+      p.y.noalias() -= p.W * p.t;
+      for(size_t k = 0;k < p.rows.size();++ k) x_.row(p.rows[k]) = p.y.row(k);
+    }
+  });
 }
 
 NAMESPACE_END(doux::pd)
\ No newline at end of file
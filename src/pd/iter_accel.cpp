@@ -0,0 +1,133 @@
+//******************************************************************************
+// iter_accel.cpp -- This file is part of Doux, a realtime softbody simulation library
+//
+// Copyright (C) 2021 Changxi Zheng <cxz@cs.columbia.edu>
+//
+// This Source Code Form is subject to the terms of the Mozilla Public License
+// v. 2.0. If a copy of the MPL was not distributed with this file, You can
+// obtain one at http://mozilla.org/MPL/2.0/.
+//******************************************************************************
+
+#include <algorithm>
+#include <limits>
+#include <Eigen/Cholesky>
+#include "doux/pd/iter_accel.h"
+
+NAMESPACE_BEGIN(doux::pd)
+
+void ChebyshevAccel::begin(const linalg::matrix_x4_r_t& x) {
+  q_prev_ = x;
+  q_curr_ = x;
+  k_ = 0;
+  omega_ = 1;
+  diff_ = 0;
+  rho_meas_ = 0;
+}
+
+void ChebyshevAccel::update(linalg::matrix_x4_r_t& x) {
+  assert(x.rows() == q_curr_.rows() && x.cols() == q_curr_.cols());
+
+  if ( warmup_ > 0 ) [[unlikely]] {
+    // plain iterations: the ratio of two consecutive updates approaches
+    // the spectral radius
+    auto const d = (x - q_curr_).norm();
+    if ( k_ > 0 && diff_ > 0 ) rho_meas_ = d / diff_;
+    diff_ = d;
+  } else {
+    // Algorithm 1 in [Wang 2015]
+    if ( k_ < delay_ ) {
+      omega_ = 1;
+    } else if ( k_ == delay_ ) {
+      omega_ = static_cast<real_t>(2) / (static_cast<real_t>(2) - rho_*rho_);
+    } else {
+      omega_ = static_cast<real_t>(4) / (static_cast<real_t>(4) - rho_*rho_*omega_);
+    }
+    x = omega_ * (gamma_ * (x - q_curr_) + q_curr_ - q_prev_) + q_prev_;
+  }
+
+  q_prev_.swap(q_curr_);
+  q_curr_ = x;
+  ++ k_;
+}
+
+void ChebyshevAccel::end() {
+  if ( warmup_ == 0 ) return;
+
+  // keep the estimate strictly below 1 to keep omega bounded
+  constexpr real_t MAX_RHO = static_cast<real_t>(0.9999);
+  rho_ = std::clamp(std::max(rho_, rho_meas_), static_cast<real_t>(0), MAX_RHO);
+  -- warmup_;
+}
+
+// ------------------------------------------------------------------------
+
+void AndersonAccel::begin(const linalg::matrix_x4_r_t& x) {
+  q_ = x;
+  nhist_ = 0;
+  col_ = 0;
+  has_prev_ = false;
+  extrapolated_ = false;
+
+  auto const n = x.size();
+  if ( dg_.rows() != n ) {
+    dg_.resize(n, m_);
+    df_.resize(n, m_);
+  }
+}
+
+bool AndersonAccel::accept(real_t e) {
+  if ( extrapolated_ && e > e_prev_ ) [[unlikely]] {
+    ++ num_rejected_;
+    return false;
+  }
+  e_prev_ = e;
+  return true;
+}
+
+const linalg::matrix_x4_r_t& AndersonAccel::fallback() {
+  assert(has_prev_);
+  // restart the acceleration from the plain iterate
+  q_ = g_prev_;
+  nhist_ = 0;
+  col_ = 0;
+  has_prev_ = false;
+  extrapolated_ = false;
+  return q_;
+}
+
+void AndersonAccel::update(linalg::matrix_x4_r_t& x) {
+  assert(x.rows() == q_.rows() && x.cols() == q_.cols());
+  auto const n = x.size();
+  Eigen::Map<const linalg::vector_r_t> g(x.data(), n);
+  Eigen::Map<const linalg::vector_r_t> q(q_.data(), n);
+  const linalg::vector_r_t f = g - q;
+
+  if ( has_prev_ ) {
+    dg_.col(col_) = g - Eigen::Map<const linalg::vector_r_t>(g_prev_.data(), n);
+    df_.col(col_) = f - f_prev_;
+    col_ = (col_ + 1) % m_;
+    nhist_ = std::min(nhist_ + 1, m_);
+  }
+  g_prev_ = x;
+  f_prev_ = f;
+  has_prev_ = true;
+
+  if ( nhist_ > 0 ) {
+    // least squares: min || f - dF \theta ||, solved using the normal equations
+    auto const dF = df_.leftCols(nhist_);
+    linalg::matrix_r_t N = dF.transpose() * dF;
+    // relative regularization above the rounding error of the entries of N,
+    // so it still has an effect in single precision
+    constexpr real_t REG = 100 * std::numeric_limits<real_t>::epsilon();
+    N.diagonal().array() += N.diagonal().maxCoeff() * REG;
+    const linalg::vector_r_t theta = N.ldlt().solve(dF.transpose() * f);
+
+    Eigen::Map<linalg::vector_r_t>(x.data(), n) -= dg_.leftCols(nhist_) * theta;
+    extrapolated_ = true;
+  } else {
+    extrapolated_ = false;
+  }
+  q_ = x;
+}
+
+NAMESPACE_END(doux::pd)
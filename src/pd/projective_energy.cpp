@@ -8,7 +8,10 @@
 // obtain one at http://mozilla.org/MPL/2.0/.
 //******************************************************************************
 
+#include <algorithm>
 #include <Eigen/LU>
+#include <Eigen/SVD>
+#include <Eigen/Geometry>
 #include "doux/pd/projective_energy.h"
 #include "doux/shape/tet.h"
 #include "doux/pd/softbody.h"
@@ -21,17 +24,22 @@ void PlaneColliEnergy::project() {
 
 // ------------------------------------------------------
 
-TetCorotEnergy::TetCorotEnergy(ProjDynBody* b, real_t s, size_t v0, size_t v1, size_t v2, size_t v3) :
-    ProjEnergy(b, s), v_{v0, v1, v2, v3},
-    restricted_vtx_{b->is_restricted(v0), b->is_restricted(v1), 
-                    b->is_restricted(v2), b->is_restricted(v3)} {
-  assert(b);
+uint32_t TetCorotBatch::add(real_t stiff, size_t v0, size_t v1, size_t v2, size_t v3) {
+  auto const t = static_cast<uint32_t>(size());
+  size_t const vs[4] = {v0, v1, v2, v3};
+  uint8_t restricted = 0;
+  for(int j = 0;j < 4;++ j) {
+    v_[j].push_back(static_cast<uint32_t>(vs[j]));
+    if ( body_->is_restricted(vs[j]) ) restricted |= 1 << j;
+  }
+  restricted_.push_back(restricted);
+  stiffness_.push_back(stiff);
 
   // rest positions
-  auto const& X0 = b->vtx_pos(v0); // vec3r
-  auto const& X1 = b->vtx_pos(v1);
-  auto const& X2 = b->vtx_pos(v2);
-  auto const& X3 = b->vtx_pos(v3);
+  auto const& X0 = body_->vtx_pos(v0); // vec3r
+  auto const& X1 = body_->vtx_pos(v1);
+  auto const& X2 = body_->vtx_pos(v2);
+  auto const& X3 = body_->vtx_pos(v3);
 
   // compute D_inv_
   Vec3r XS[3] = {X1 - X0, X2 - X0, X3 - X0};
@@ -40,48 +48,580 @@ TetCorotEnergy::TetCorotEnergy(ProjDynBody* b, real_t s, size_t v0, size_t v1, s
   linalg::mat3_r_t m = Eigen::Map<linalg::mat3_r_t, 0, 
                                   Eigen::OuterStride<sizeof(Vec3r)/sizeof(real_t)>>
                                   (reinterpret_cast<real_t*>(XS));
-  D_inv_ = m.inverse();
-  d_sum_ = D_inv_.colwise().sum();
+  const linalg::mat3_r_t D_inv = m.inverse();
+  const linalg::vec3_r_t d_sum = D_inv.colwise().sum();
+  for(int k = 0;k < 9;++ k) {
+    D_inv_[k].push_back(D_inv.data()[k]);
+    r_[k].push_back(k % 4 == 0 ? 1 : 0);  // identity
+  }
+  for(int k = 0;k < 3;++ k) d_sum_[k].push_back(d_sum(k));
+  for(int k = 0;k < 4;++ k) q_[k].push_back(k == 0 ? 1 : 0);  // identity
+  return t;
 }
 
-real_t TetCorotEnergy::val() const {
-  // current positions
-  auto const& x0 = body_->vtx_pos(v_[0]); // vec3r
-  auto const& x1 = body_->vtx_pos(v_[1]);
-  auto const& x2 = body_->vtx_pos(v_[2]);
-  auto const& x3 = body_->vtx_pos(v_[3]);
+void TetCorotBatch::set_rot_iters(uint32_t n) {
+  // start the iterations from the current rotations
+  if ( n && !rot_iters_ ) {
+    for(size_t t = 0;t < size();++ t) {
+      const Eigen::Quaternion<real_t> q(rot(t));
+      q_[0][t] = q.w(); q_[1][t] = q.x(); q_[2][t] = q.y(); q_[3][t] = q.z();
+    }
+  }
+  rot_iters_ = n;
+}
 
-  // compute D_inv_
-  Vec3r xs[3] = {x1 - x0, x2 - x0, x3 - x0};
-  linalg::mat3_r_t m = Eigen::Map<linalg::mat3_r_t, 0, 
-                                  Eigen::OuterStride<sizeof(Vec3r)/sizeof(real_t)>>
-                                  (reinterpret_cast<real_t*>(xs));
-  return (m * D_inv_ - r_).squaredNorm() * stiffness_ * static_cast<real_t>(0.5);
+linalg::mat3_r_t TetCorotBatch::rot(size_t t) const {
+  linalg::mat3_r_t r;
+  for(int k = 0;k < 9;++ k) r.data()[k] = r_[k][t];
+  return r;
 }
 
-void TetCorotEnergy::project() {
+linalg::mat3_r_t TetCorotBatch::rhs_proj(size_t t) const {
+  // restricted vertices are not part of the global system, so move their 
+  // terms to the RHS
+  linalg::mat3_r_t p = rot(t);
+  if ( restricted_[t] ) [[unlikely]] {
+    for(int k = 0;k < 4;++ k) {
+      if ( !restricted(t, k) ) continue;
+      auto const& xk = body_->pred_pos(v_[k][t]);
+      p -= linalg::vec3_r_t(xk.x(), xk.y(), xk.z()) * coeff(t, k).transpose();
+    }
+  }
+  return p;
 }
 
-void TetCorotEnergy::register_global_solve_elems(GlobalSolver* solver) {
+// terms projected together, one per lane of an AVX register
+static constexpr size_t ROT_LANES = 32 / sizeof(real_t);
+using rot_lane_t = SVector<real_t, ROT_LANES>;
+
+// number of the scaled Newton iterations, enough for stretches up to ~1E3
+static constexpr int POLAR_ITERS = std::is_same_v<real_t, float> ? 6 : 8;
+
+// cross product of two columns stored as lanes
+static DOUX_ALWAYS_INLINE void lane_cross(const rot_lane_t* a, const rot_lane_t* b, rot_lane_t* c) {
+  c[0] = a[1] * b[2] - a[2] * b[1];
+  c[1] = a[2] * b[0] - a[0] * b[2];
+  c[2] = a[0] * b[1] - a[1] * b[0];
+}
+
+/*
+ * Rotation factor of the polar decomposition F = R S of ROT_LANES 3x3 
+ * matrices at once (column-major, one matrix per lane), by the scaled Newton 
+ * iteration [Higham 1986]
+ *   R <- (g R + R^{-T} / g) / 2,  g = (|R^{-1}|_F / |R|_F)^{1/2}
+ * The iteration count is fixed, so all lanes run the same instructions. 
+ * All matrices must have positive determinants.
+ */
+static void polar_rot(rot_lane_t (&R)[9]) {
+  for(int it = 0;it < POLAR_ITERS;++ it) {
+    // columns of the cofactor matrix, R^{-T} = C / det(R)
+    rot_lane_t C[9];
+    lane_cross(R + 3, R + 6, C);
+    lane_cross(R + 6, R, C + 3);
+    lane_cross(R, R + 3, C + 6);
+    const rot_lane_t det = R[0] * C[0] + R[1] * C[1] + R[2] * C[2];
+
+    rot_lane_t r2 = R[0] * R[0], c2 = C[0] * C[0];
+    for(int k = 1;k < 9;++ k) {
+      r2 += R[k] * R[k];
+      c2 += C[k] * C[k];
+    }
+    // g^4 = |C|_F^2 / (det^2 |R|_F^2)
+    const rot_lane_t g = (c2 / (det * det * r2)).sqrt().sqrt();
+    const rot_lane_t a = g * (real_t)0.5;
+    const rot_lane_t c = rot_lane_t((real_t)0.5) / (g * det);
+    for(int k = 0;k < 9;++ k) R[k] = R[k] * a + C[k] * c;
+  }
+}
+
+// rotation matrices (column-major) of unit quaternions (w, x, y, z)
+static DOUX_ALWAYS_INLINE void lane_quat_rot(const rot_lane_t (&q)[4], rot_lane_t (&R)[9]) {
+  const rot_lane_t xx = q[1] * q[1], yy = q[2] * q[2], zz = q[3] * q[3];
+  const rot_lane_t xy = q[1] * q[2], xz = q[1] * q[3], yz = q[2] * q[3];
+  const rot_lane_t wx = q[0] * q[1], wy = q[0] * q[2], wz = q[0] * q[3];
+  R[0] = rot_lane_t((real_t)1) - (yy + zz) * (real_t)2;
+  R[1] = (xy + wz) * (real_t)2;
+  R[2] = (xz - wy) * (real_t)2;
+  R[3] = (xy - wz) * (real_t)2;
+  R[4] = rot_lane_t((real_t)1) - (xx + zz) * (real_t)2;
+  R[5] = (yz + wx) * (real_t)2;
+  R[6] = (xz + wy) * (real_t)2;
+  R[7] = (yz - wx) * (real_t)2;
+  R[8] = rot_lane_t((real_t)1) - (xx + yy) * (real_t)2;
+}
+
+/*
+ * Iterative rotation extraction [Mueller et al. 2016], warm-started from the 
+ * quaternions q of the previous projection. Each iteration rotates R by 
+ *   w = \sum_i r_i x f_i / (|\sum_i r_i . f_i| + eps)
+ * (r_i, f_i: columns of R and F), using the rotation of the unnormalized 
+ * quaternion (1, w/2) in place of the exact exponential map, as they agree 
+ * to the first order and share the fixed point w = 0. Unlike the polar 
+ * decomposition, it always returns a rotation, also for inverted terms.
+ */
+static void iter_rot(const rot_lane_t (&F)[9], rot_lane_t (&q)[4], 
+                     rot_lane_t (&R)[9], uint32_t niters) {
+  for(uint32_t it = 0;it < niters;++ it) {
+    lane_quat_rot(q, R);
+    rot_lane_t w[3] = {(real_t)0, (real_t)0, (real_t)0}, c[3];
+    rot_lane_t d = (real_t)0;
+    for(int k = 0;k < 3;++ k) {
+      lane_cross(R + 3*k, F + 3*k, c);
+      for(int i = 0;i < 3;++ i) w[i] += c[i];
+      d += R[3*k] * F[3*k] + R[3*k+1] * F[3*k+1] + R[3*k+2] * F[3*k+2];
+    }
+    // (1, w/2) * q
+    const rot_lane_t s = rot_lane_t((real_t)0.5) / ((d * d).sqrt() + eps<real_t>::v);
+    for(int i = 0;i < 3;++ i) w[i] *= s;
+    rot_lane_t p[4];
+    p[0] = q[0] - (w[0] * q[1] + w[1] * q[2] + w[2] * q[3]);
+    lane_cross(w, q + 1, p + 1);
+    for(int i = 0;i < 3;++ i) p[i+1] += q[i+1] + w[i] * q[0];
+
+    const rot_lane_t inv = (p[0] * p[0] + p[1] * p[1] + p[2] * p[2] + p[3] * p[3]).sqrt().rcp();
+    for(int i = 0;i < 4;++ i) q[i] = p[i] * inv;
+  }
+  lane_quat_rot(q, R);
+}
+
+// the closest rotation to F, including the inverted and degenerate cases
+static linalg::mat3_r_t svd_rot(const linalg::mat3_r_t& F) {
+  Eigen::JacobiSVD<linalg::mat3_r_t> svd(F, Eigen::ComputeFullU | Eigen::ComputeFullV);
+  linalg::mat3_r_t U = svd.matrixU();
+  const linalg::mat3_r_t& V = svd.matrixV();
+  // flip the direction of the smallest singular value to avoid a reflection
+  if ( (U * V.transpose()).determinant() < 0 ) U.col(2) = -U.col(2);
+  return U * V.transpose();
+}
+
+void TetCorotBatch::project(size_t b, size_t e) {
+  assert(b <= e && e <= size());
+
+  for(size_t g = b;g < e;g += ROT_LANES) {
+    size_t const n = std::min(ROT_LANES, e - g);
+
+    // deformation gradients F = (x1-x0, x2-x0, x3-x0) D^{-1}; the lanes 
+    // after the last term repeat it
+    rot_lane_t X[4][3], D[9];
+    for(size_t l = 0;l < ROT_LANES;++ l) {
+      size_t const t = g + std::min(l, n - 1);
+      for(int j = 0;j < 4;++ j) {
+        auto const& x = body_->pred_pos(v_[j][t]);
+        X[j][0][l] = x.x(); X[j][1][l] = x.y(); X[j][2][l] = x.z();
+      }
+      for(int k = 0;k < 9;++ k) D[k][l] = D_inv_[k][t];
+    }
+    rot_lane_t E[3][3];
+    for(int m = 0;m < 3;++ m) {
+      for(int i = 0;i < 3;++ i) E[m][i] = X[m+1][i] - X[0][i];
+    }
+    rot_lane_t R[9];
+    for(int k = 0;k < 3;++ k) {
+      for(int i = 0;i < 3;++ i) {
+        R[3*k+i] = E[0][i] * D[3*k] + E[1][i] * D[3*k+1] + E[2][i] * D[3*k+2];
+      }
+    }
+
+    if ( rot_iters_ ) {
+      rot_lane_t q[4], F[9];
+      for(size_t l = 0;l < ROT_LANES;++ l) {
+        size_t const t = g + std::min(l, n - 1);
+        for(int k = 0;k < 4;++ k) q[k][l] = q_[k][t];
+      }
+      std::copy(R, R + 9, F);
+      iter_rot(F, q, R, rot_iters_);
+      for(size_t l = 0;l < n;++ l) {
+        for(int k = 0;k < 4;++ k) q_[k][g + l] = q[k][l];
+        for(int k = 0;k < 9;++ k) r_[k][g + l] = R[k][l];
+      }
+      continue;
+    }
+
+    // the inverted or (nearly) degenerate terms are solved by SVD, and 
+    // replaced with the identity in the lanes
+    uint32_t bad = 0;
+    linalg::mat3_r_t F;
+    {
+      rot_lane_t C[3];
+      lane_cross(R + 3, R + 6, C);
+      const rot_lane_t det = R[0] * C[0] + R[1] * C[1] + R[2] * C[2];
+      rot_lane_t r2 = R[0] * R[0];
+      for(int k = 1;k < 9;++ k) r2 += R[k] * R[k];
+      for(size_t l = 0;l < n;++ l) {
+        real_t const s = r2[l];
+        if ( det[l] > eps<real_t>::v * s * std::sqrt(s) ) [[likely]] continue;
+        bad |= 1u << l;
+        for(int k = 0;k < 9;++ k) {
+          F.data()[k] = R[k][l];
+          R[k][l] = k % 4 == 0 ? 1 : 0;
+        }
+        const linalg::mat3_r_t r = svd_rot(F);
+        for(int k = 0;k < 9;++ k) r_[k][g + l] = r.data()[k];
+      }
+    }
+
+    polar_rot(R);
+    for(size_t l = 0;l < n;++ l) {
+      if ( (bad >> l) & 1 ) [[unlikely]] continue;
+      for(int k = 0;k < 9;++ k) r_[k][g + l] = R[k][l];
+    }
+  }
+}
+
+void TetCorotBatch::register_global_solve_rhs(GlobalSolver* solver) const {
+  // b_j = w p c_j = \sum_i (w c_j(i)) p.col(i)
+  for(size_t t = 0;t < size();++ t) {
+    for(int j = 0;j < 4;++ j) {
+      if ( restricted(t, j) ) [[unlikely]] continue;
+      auto const cj = coeff(t, j);
+      for(uint32_t i = 0;i < 3;++ i) {
+        solver->add_rhs_elem(body_, v_[j][t], t * 3 + i, cj(i) * stiffness_[t]);
+      }
+    }
+  }
+}
+
+void TetCorotBatch::store_proj_rows(linalg::matrix_x4_r_t& P, size_t row, size_t b, size_t e) const {
+  for(size_t t = b;t < e;++ t, row += 3) {
+    if ( restricted_[t] ) [[unlikely]] {
+      const linalg::mat3_r_t p = rhs_proj(t);
+      for(int i = 0;i < 3;++ i) P.row(row + i) = linalg::row4_r_t(p(0, i), p(1, i), p(2, i), 0);
+      continue;
+    }
+    // column i of the rotation
+    for(int i = 0;i < 3;++ i) {
+      P.row(row + i) = linalg::row4_r_t(r_[3*i][t], r_[3*i+1][t], r_[3*i+2][t], 0);
+    }
+  }
+}
+
+real_t TetCorotBatch::val(size_t b, size_t e) const {
+  real_t v = 0;
+  for(size_t t = b;t < e;++ t) {
+    // deformation gradient of the current positions (i.e., the current 
+    // iterate in PD iterations)
+    linalg::mat3_r_t F = linalg::mat3_r_t::Zero();
+    for(int j = 0;j < 4;++ j) {
+      auto const& xj = body_->pred_pos(vtx(t, j)); // vec3r
+      F += linalg::vec3_r_t(xj.x(), xj.y(), xj.z()) * coeff(t, j).transpose();
+    }
+    v += (F - rot(t)).squaredNorm() * stiffness_[t] * static_cast<real_t>(0.5);
+  }
+  return v;
+}
+
+void TetCorotBatch::register_global_solve_elems(GlobalSolver* solver, size_t t) const {
   for(int i = 0;i < 3;++ i) {
     for(int j = 0;j < 4;++ j) {
       // diagonal element
-      if ( restricted_vtx_[j] ) [[unlikely]] continue;
+      if ( restricted(t, j) ) [[unlikely]] continue;
 
-      real_t cj = j == 0 ? -d_sum_(i) : D_inv_(j-1, i);
-      solver->add_elem(body_, v_[j], cj*cj*stiffness_);
+      real_t cj = coeff(t, j)(i);
+      solver->add_elem(body_, vtx(t, j), cj*cj*stiffness_[t]);
       // off-diagonal element
       for(int k = 0;k < j;++ k) {
-        if ( restricted_vtx_[k] ) [[unlikely]] continue;
+        if ( restricted(t, k) ) [[unlikely]] continue;
 
-        real_t ck = k == 0 ? -d_sum_(i) : D_inv_(k-1, i);
-        solver->add_elem(body_, v_[j], body_, v_[k], cj*ck*stiffness_);
+        real_t ck = coeff(t, k)(i);
+        solver->add_elem(body_, vtx(t, j), body_, vtx(t, k), cj*ck*stiffness_[t]);
       }
     }
   } // end for i
 }
 
+void TetCorotBatch::update_global_solve_rhs(GlobalSolver* solver, size_t t) const {
+  const linalg::mat3_r_t p = rhs_proj(t);
+  for(int j = 0;j < 4;++ j) {
+    if ( restricted(t, j) ) [[unlikely]] continue;
+    const linalg::vec3_r_t bj = p * coeff(t, j) * stiffness_[t];
+    solver->add_rhs(body_, vtx(t, j), Vec3r(bj(0), bj(1), bj(2)));
+  }
+}
+
+void TetCorotBatch::apply_global_solve_mat(GlobalSolver* solver, size_t t) const {
+  // A_i^T A_i p = \sum_j c_j^T (\sum_k p_k c_k^T) over the free vertices, 
+  // where each p_k is a (x, y, z, 0) row
+  linalg::vec3_r_t c[4];
+  for(int j = 0;j < 4;++ j) c[j] = coeff(t, j);
+
+  linalg::row4_r_t u[3] = {linalg::row4_r_t::Zero(), linalg::row4_r_t::Zero(), 
+                           linalg::row4_r_t::Zero()};
+  for(int k = 0;k < 4;++ k) {
+    if ( restricted(t, k) ) [[unlikely]] continue;
+    const linalg::row4_r_t pk = solver->mat_vec_in(body_, vtx(t, k));
+    for(int m = 0;m < 3;++ m) u[m] += c[k](m) * pk;
+  }
+  for(int j = 0;j < 4;++ j) {
+    if ( restricted(t, j) ) [[unlikely]] continue;
+    solver->mat_vec_out(body_, vtx(t, j), 
+        (c[j](0) * u[0] + c[j](1) * u[1] + c[j](2) * u[2]) * stiffness_[t]);
+  }
+}
+
+// ------------------------------------------------------
+
+TetCorotEnergy::TetCorotEnergy(ProjDynBody* b, real_t s, size_t v0, size_t v1, size_t v2, size_t v3) :
+    ProjEnergy(b, s), batch_{&b->energy_batch<TetCorotBatch>()} {
+  assert(b);
+  idx_ = batch_->add(s, v0, v1, v2, v3);
+}
+
+real_t TetCorotEnergy::val() const {
+  return batch_->val(idx_, idx_ + 1);
+}
+
+void TetCorotEnergy::project() {
+  batch_->project(idx_, idx_ + 1);
+}
+
+void TetCorotEnergy::register_global_solve_elems(GlobalSolver* solver) {
+  batch_->register_global_solve_elems(solver, idx_);
+}
+
 void TetCorotEnergy::update_global_solve_rhs(GlobalSolver* solver) {
+  batch_->update_global_solve_rhs(solver, idx_);
+}
+
+void TetCorotEnergy::apply_global_solve_mat(GlobalSolver* solver) const {
+  batch_->apply_global_solve_mat(solver, idx_);
+}
+
+// ------------------------------------------------------
+
+uint32_t TriCorotBatch::add(real_t stiff, size_t v0, size_t v1, size_t v2) {
+  auto const t = static_cast<uint32_t>(size());
+  size_t const vs[3] = {v0, v1, v2};
+  uint8_t restricted = 0;
+  for(int j = 0;j < 3;++ j) {
+    v_[j].push_back(static_cast<uint32_t>(vs[j]));
+    if ( body_->is_restricted(vs[j]) ) restricted |= 1 << j;
+  }
+  restricted_.push_back(restricted);
+  stiffness_.push_back(stiff);
+
+  // rest positions
+  auto const& X0 = body_->vtx_pos(v0); // vec3r
+  auto const& X1 = body_->vtx_pos(v1);
+  auto const& X2 = body_->vtx_pos(v2);
+
+  // rest edges in the 2D frame of the triangle (as in StVKTriCFunc)
+  auto const X10 = X1 - X0;
+  auto const X20 = X2 - X0;
+  auto const cxs = cross(X10, X20);
+  assert(cxs.norm() > eps<real_t>::v);
+  auto const ax1 = X10.normalize();
+  auto const ax2 = cross(cxs, ax1).normalize();
+
+  linalg::mat2_r_t D;
+  D << ax1.dot(X10), ax1.dot(X20),
+       ax2.dot(X10), ax2.dot(X20);
+  const linalg::mat2_r_t D_inv = D.inverse();
+  const linalg::vec2_r_t d_sum = D_inv.colwise().sum();
+  for(int k = 0;k < 4;++ k) D_inv_[k].push_back(D_inv.data()[k]);
+  for(int k = 0;k < 2;++ k) d_sum_[k].push_back(d_sum(k));
+  // the rest frame
+  for(int k = 0;k < 3;++ k) {
+    r_[k].push_back(ax1[k]);
+    r_[k+3].push_back(ax2[k]);
+  }
+  return t;
+}
+
+Eigen::Matrix<real_t, 3, 2> TriCorotBatch::rot(size_t t) const {
+  Eigen::Matrix<real_t, 3, 2> r;
+  for(int k = 0;k < 6;++ k) r.data()[k] = r_[k][t];
+  return r;
+}
+
+Eigen::Matrix<real_t, 3, 2> TriCorotBatch::rhs_proj(size_t t) const {
+  // restricted vertices are not part of the global system, so move their 
+  // terms to the RHS
+  Eigen::Matrix<real_t, 3, 2> p = rot(t);
+  if ( restricted_[t] ) [[unlikely]] {
+    for(int k = 0;k < 3;++ k) {
+      if ( !restricted(t, k) ) continue;
+      auto const& xk = body_->pred_pos(v_[k][t]);
+      p -= linalg::vec3_r_t(xk.x(), xk.y(), xk.z()) * coeff(t, k).transpose();
+    }
+  }
+  return p;
+}
+
+void TriCorotBatch::project(size_t b, size_t e) {
+  assert(b <= e && e <= size());
+
+  for(size_t g = b;g < e;g += ROT_LANES) {
+    size_t const n = std::min(ROT_LANES, e - g);
+
+    // deformation gradients F = (x1-x0, x2-x0) D^{-1}; the lanes after the 
+    // last term repeat it
+    rot_lane_t X[3][3], D[4];
+    for(size_t l = 0;l < ROT_LANES;++ l) {
+      size_t const t = g + std::min(l, n - 1);
+      for(int j = 0;j < 3;++ j) {
+        auto const& x = body_->pred_pos(v_[j][t]);
+        X[j][0][l] = x.x(); X[j][1][l] = x.y(); X[j][2][l] = x.z();
+      }
+      for(int k = 0;k < 4;++ k) D[k][l] = D_inv_[k][t];
+    }
+    rot_lane_t F[6];
+    for(int i = 0;i < 3;++ i) {
+      const rot_lane_t e1 = X[1][i] - X[0][i], e2 = X[2][i] - X[0][i];
+      F[i]   = e1 * D[0] + e2 * D[1];
+      F[i+3] = e1 * D[2] + e2 * D[3];
+    }
+
+    /*
+     * R = F (F^T F)^{-1/2} in closed form: with C = F^T F, s = det(C)^{1/2}
+     * and t = (tr(C) + 2s)^{1/2}, (F^T F)^{1/2} = (C + s I) / t, whose 
+     * inverse is adj(C + s I) / (s t)
+     */
+    rot_lane_t c00 = F[0] * F[0] + F[1] * F[1] + F[2] * F[2];
+    rot_lane_t c11 = F[3] * F[3] + F[4] * F[4] + F[5] * F[5];
+    rot_lane_t c01 = F[0] * F[3] + F[1] * F[4] + F[2] * F[5];
+    rot_lane_t det = c00 * c11 - c01 * c01;
+
+    // the (nearly) degenerate terms are solved by SVD, and replaced with 
+    // C = I in the lanes
+    uint32_t bad = 0;
+    for(size_t l = 0;l < n;++ l) {
+      real_t const tr = c00[l] + c11[l];
+      if ( det[l] > eps<real_t>::v * tr * tr ) [[likely]] continue;
+      bad |= 1u << l;
+      Eigen::Matrix<real_t, 3, 2> Fl;
+      for(int k = 0;k < 6;++ k) Fl.data()[k] = F[k][l];
+      Eigen::JacobiSVD<Eigen::Matrix<real_t, 3, 2>> svd(Fl, Eigen::ComputeFullU | Eigen::ComputeFullV);
+      const Eigen::Matrix<real_t, 3, 2> r = svd.matrixU().leftCols<2>() * svd.matrixV().transpose();
+      for(int k = 0;k < 6;++ k) r_[k][g + l] = r.data()[k];
+      c00[l] = c11[l] = det[l] = 1;
+      c01[l] = 0;
+    }
+
+    const rot_lane_t s = det.sqrt();
+    const rot_lane_t inv = ((c00 + c11 + s * (real_t)2).sqrt() * s).rcp();
+    const rot_lane_t a00 = (c11 + s) * inv, a11 = (c00 + s) * inv, a01 = c01 * inv;
+    for(size_t l = 0;l < n;++ l) {
+      if ( (bad >> l) & 1 ) [[unlikely]] continue;
+      for(int i = 0;i < 3;++ i) {
+        r_[i][g + l]   = F[i][l] * a00[l] - F[i+3][l] * a01[l];
+        r_[i+3][g + l] = F[i+3][l] * a11[l] - F[i][l] * a01[l];
+      }
+    }
+  }
+}
+
+void TriCorotBatch::register_global_solve_rhs(GlobalSolver* solver) const {
+  // b_j = w p c_j = \sum_i (w c_j(i)) p.col(i)
+  for(size_t t = 0;t < size();++ t) {
+    for(int j = 0;j < 3;++ j) {
+      if ( restricted(t, j) ) [[unlikely]] continue;
+      auto const cj = coeff(t, j);
+      for(uint32_t i = 0;i < 2;++ i) {
+        solver->add_rhs_elem(body_, v_[j][t], t * 2 + i, cj(i) * stiffness_[t]);
+      }
+    }
+  }
+}
+
+void TriCorotBatch::store_proj_rows(linalg::matrix_x4_r_t& P, size_t row, size_t b, size_t e) const {
+  for(size_t t = b;t < e;++ t, row += 2) {
+    if ( restricted_[t] ) [[unlikely]] {
+      const Eigen::Matrix<real_t, 3, 2> p = rhs_proj(t);
+      for(int i = 0;i < 2;++ i) P.row(row + i) = linalg::row4_r_t(p(0, i), p(1, i), p(2, i), 0);
+      continue;
+    }
+    for(int i = 0;i < 2;++ i) {
+      P.row(row + i) = linalg::row4_r_t(r_[3*i][t], r_[3*i+1][t], r_[3*i+2][t], 0);
+    }
+  }
+}
+
+real_t TriCorotBatch::val(size_t b, size_t e) const {
+  real_t v = 0;
+  for(size_t t = b;t < e;++ t) {
+    Eigen::Matrix<real_t, 3, 2> F = Eigen::Matrix<real_t, 3, 2>::Zero();
+    for(int j = 0;j < 3;++ j) {
+      auto const& xj = body_->pred_pos(vtx(t, j)); // vec3r
+      F += linalg::vec3_r_t(xj.x(), xj.y(), xj.z()) * coeff(t, j).transpose();
+    }
+    v += (F - rot(t)).squaredNorm() * stiffness_[t] * static_cast<real_t>(0.5);
+  }
+  return v;
+}
+
+void TriCorotBatch::register_global_solve_elems(GlobalSolver* solver, size_t t) const {
+  for(int i = 0;i < 2;++ i) {
+    for(int j = 0;j < 3;++ j) {
+      // diagonal element
+      if ( restricted(t, j) ) [[unlikely]] continue;
+
+      real_t cj = coeff(t, j)(i);
+      solver->add_elem(body_, vtx(t, j), cj*cj*stiffness_[t]);
+      // off-diagonal element
+      for(int k = 0;k < j;++ k) {
+        if ( restricted(t, k) ) [[unlikely]] continue;
+
+        real_t ck = coeff(t, k)(i);
+        solver->add_elem(body_, vtx(t, j), body_, vtx(t, k), cj*ck*stiffness_[t]);
+      }
+    }
+  } // end for i
+}
+
+void TriCorotBatch::update_global_solve_rhs(GlobalSolver* solver, size_t t) const {
+  const Eigen::Matrix<real_t, 3, 2> p = rhs_proj(t);
+  for(int j = 0;j < 3;++ j) {
+    if ( restricted(t, j) ) [[unlikely]] continue;
+    const linalg::vec3_r_t bj = p * coeff(t, j) * stiffness_[t];
+    solver->add_rhs(body_, vtx(t, j), Vec3r(bj(0), bj(1), bj(2)));
+  }
+}
+
+void TriCorotBatch::apply_global_solve_mat(GlobalSolver* solver, size_t t) const {
+  // A_i^T A_i p = \sum_j c_j^T (\sum_k p_k c_k^T) over the free vertices, 
+  // where each p_k is a (x, y, z, 0) row
+  linalg::vec2_r_t c[3];
+  for(int j = 0;j < 3;++ j) c[j] = coeff(t, j);
+
+  linalg::row4_r_t u[2] = {linalg::row4_r_t::Zero(), linalg::row4_r_t::Zero()};
+  for(int k = 0;k < 3;++ k) {
+    if ( restricted(t, k) ) [[unlikely]] continue;
+    const linalg::row4_r_t pk = solver->mat_vec_in(body_, vtx(t, k));
+    for(int m = 0;m < 2;++ m) u[m] += c[k](m) * pk;
+  }
+  for(int j = 0;j < 3;++ j) {
+    if ( restricted(t, j) ) [[unlikely]] continue;
+    solver->mat_vec_out(body_, vtx(t, j), 
+        (c[j](0) * u[0] + c[j](1) * u[1]) * stiffness_[t]);
+  }
+}
+
+// ------------------------------------------------------
+
+TriCorotEnergy::TriCorotEnergy(ProjDynBody* b, real_t s, size_t v0, size_t v1, size_t v2) :
+    ProjEnergy(b, s), batch_{&b->energy_batch<TriCorotBatch>()} {
+  assert(b);
+  idx_ = batch_->add(s, v0, v1, v2);
+}
+
+real_t TriCorotEnergy::val() const {
+  return batch_->val(idx_, idx_ + 1);
+}
+
+void TriCorotEnergy::project() {
+  batch_->project(idx_, idx_ + 1);
+}
+
+void TriCorotEnergy::register_global_solve_elems(GlobalSolver* solver) {
+  batch_->register_global_solve_elems(solver, idx_);
+}
+
+void TriCorotEnergy::update_global_solve_rhs(GlobalSolver* solver) {
+  batch_->update_global_solve_rhs(solver, idx_);
+}
+
+void TriCorotEnergy::apply_global_solve_mat(GlobalSolver* solver) const {
+  batch_->apply_global_solve_mat(solver, idx_);
 }
 
-NAMESPACE_END(doux::pd)
\ No newline at end of file
+NAMESPACE_END(doux::pd)
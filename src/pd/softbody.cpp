@@ -9,30 +9,58 @@
 //******************************************************************************
 
 #include "doux/pd/softbody.h"
+#include "doux/pd/projective_energy.h"
 
 NAMESPACE_BEGIN(doux::pd)
 
 void MotiveBody::predict_vel_pos(const Vec3r& a, real_t dt) {
   for(size_t i = num_restricted_;i < vel_.size();++ i) {
     vel_[i] += a*dt;
-    pred_pos_[i] = pos_[i] + vel_[i]*dt;
+    pred_free_[i - num_restricted_] = pos_[i] + vel_[i]*dt;
   }
 }
 
 void MotiveBody::predict_pos(real_t dt) {
   for(size_t i = num_restricted_;i < vel_.size();++ i) {
-    pred_pos_[i] = pos_[i] + vel_[i]*dt;
+    pred_free_[i - num_restricted_] = pos_[i] + vel_[i]*dt;
   }
 }
 
 void MotiveBody::update_vel_pos(real_t dt) {
   const real_t inv_dt = static_cast<real_t>(1) / dt;
-  UNIMPLEMENTED
 
   for(size_t i = num_restricted_;i < vel_.size();++ i) {
-    vel_[i] = (pred_pos_[i] - pos_[i]) * inv_dt;
-    pos_[i] = pred_pos_[i];
+    auto const& p = pred_free_[i - num_restricted_];
+    vel_[i] = (p - pos_[i]) * inv_dt;
+    pos_[i] = p;
   }
 }
 
+// ----------------------------------------------------------------------
+
+void ProjDynBody::project() {
+  // each batch runs the local step of its terms in a tight loop
+  for(auto& b : batches_) b->project(0, b->size());
+  for(auto& e : e_) e->project();
+}
+
+real_t ProjDynBody::energy() const {
+  real_t v = 0;
+  for(auto const& b : batches_) v += b->val(0, b->size());
+  for(auto const& e : e_) v += e->val();
+  return v;
+}
+
+ProjEnergyBatch* ProjDynBody::find_batch(ProjEnergyType type) const {
+  for(auto const& b : batches_) {
+    if ( b->type() == type ) return b.get();
+  }
+  return nullptr;
+}
+
+ProjEnergyBatch& ProjDynBody::add_batch(std::unique_ptr<ProjEnergyBatch> b) {
+  assert(!find_batch(b->type()));
+  return *batches_.emplace_back(std::move(b));
+}
+
 NAMESPACE_END(doux::pd)
\ No newline at end of file
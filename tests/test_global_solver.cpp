@@ -0,0 +1,802 @@
+//******************************************************************************
+// test_global_solver.cpp -- This file is part of Doux, a realtime softbody simulation library
+//
+// Copyright (C) 2021 Changxi Zheng <cxz@cs.columbia.edu>
+//
+// This Source Code Form is subject to the terms of the Mozilla Public License
+// v. 2.0. If a copy of the MPL was not distributed with this file, You can
+// obtain one at http://mozilla.org/MPL/2.0/.
+//******************************************************************************
+#include <gtest/gtest.h>
+#include <Eigen/Dense>
+
+#include "common.h"
+#include "doux/pd/global_solver.h"
+#include "doux/pd/projective_energy.h"
+#include "doux/shape/tet.h"
+
+using namespace doux;
+
+// A unit cube split into 5 tets. The first nfixed vertices are fixed.
+static pd::ProjDynBody unit_cube_body(size_t nfixed) {
+  std::vector<Vec3r> ps;
+  for(int i = 0;i < 8;++ i) {
+    ps.emplace_back((real_t)(i & 1), (real_t)((i >> 1) & 1), (real_t)((i >> 2) & 1));
+  }
+  linalg::matrix_i_t fs(1, 3);
+  fs << 0, 1, 2;
+
+  std::vector<Vec3r> p0;
+  std::vector<pd::MotiveBody::MotionFunc> script;
+  return pd::ProjDynBody(std::move(ps), std::move(fs), nfixed, std::move(p0), std::move(script));
+}
+
+static void add_cube_energies(pd::ProjDynBody& b, real_t stiff) {
+  static const uint32_t tets[5][4] = {
+      {0, 1, 2, 4}, {3, 2, 1, 7}, {5, 4, 7, 1}, {6, 7, 4, 2}, {1, 2, 4, 7}};
+  for(auto const& t : tets) {
+    auto const vol = shape::signed_tet_volume(b.vtx_pos(t[0]), b.vtx_pos(t[1]),
+                                              b.vtx_pos(t[2]), b.vtx_pos(t[3]));
+    if ( vol > 0 ) {
+      b.add_energy<pd::TetCorotEnergy>(stiff, t[0], t[1], t[2], t[3]);
+    } else {
+      b.add_energy<pd::TetCorotEnergy>(stiff, t[0], t[2], t[1], t[3]);
+    }
+  }
+}
+
+// Add a grid of nx x ny x nz unit cubes, each split into 6 tets. The vertices 
+// at x = 0 are fixed. (The energies keep a pointer to the softbody, so it is
+// constructed in place.)
+static void add_grid_body(std::vector<pd::ProjDynBody>& bodies, 
+                          int nx, int ny, int nz, real_t stiff) {
+  auto const vid = [&](int i, int j, int k) { return (i * (ny+1) + j) * (nz+1) + k; };
+  std::vector<Vec3r> ps;
+  for(int i = 0;i <= nx;++ i) 
+    for(int j = 0;j <= ny;++ j) 
+      for(int k = 0;k <= nz;++ k) ps.emplace_back((real_t)i, (real_t)j, (real_t)k);
+  linalg::matrix_i_t fs(1, 3);
+  fs << 0, 1, 2;
+  auto& b = bodies.emplace_back(std::move(ps), std::move(fs), (ny+1) * (nz+1), 
+                                std::vector<Vec3r>{}, std::vector<pd::MotiveBody::MotionFunc>{});
+
+  // the 6 tets around the diagonal of a cube from (0,0,0) to (1,1,1)
+  static const int axes[6][3] = {{0,1,2}, {0,2,1}, {1,0,2}, {1,2,0}, {2,0,1}, {2,1,0}};
+  for(int i = 0;i < nx;++ i) 
+    for(int j = 0;j < ny;++ j) 
+      for(int k = 0;k < nz;++ k) {
+        for(auto const& a : axes) {
+          int c[3] = {i, j, k};
+          uint32_t v[4];
+          v[0] = vid(c[0], c[1], c[2]);
+          for(int t = 0;t < 3;++ t) {
+            ++ c[a[t]];
+            v[t+1] = vid(c[0], c[1], c[2]);
+          }
+          if ( shape::signed_tet_volume(b.vtx_pos(v[0]), b.vtx_pos(v[1]),
+                                        b.vtx_pos(v[2]), b.vtx_pos(v[3])) < 0 ) {
+            std::swap(v[1], v[2]);
+          }
+          b.add_energy<pd::TetCorotEnergy>(stiff, v[0], v[1], v[2], v[3]);
+        }
+      }
+}
+
+// A cloth sheet of nx x nz unit squares (2 triangles each) in the plane y = 0,
+// with the vertices on the edge z = 0 fixed
+static void add_sheet_body(std::vector<pd::ProjDynBody>& bodies, int nx, int nz, real_t stiff) {
+  auto const vid = [&](int i, int k) { return k * (nx+1) + i; };
+  std::vector<Vec3r> ps;
+  for(int k = 0;k <= nz;++ k) 
+    for(int i = 0;i <= nx;++ i) ps.emplace_back((real_t)i, (real_t)0, (real_t)k);
+  linalg::matrix_i_t fs(1, 3);
+  fs << 0, 1, 2;
+  auto& b = bodies.emplace_back(std::move(ps), std::move(fs), nx + 1, 
+                                std::vector<Vec3r>{}, std::vector<pd::MotiveBody::MotionFunc>{});
+  for(int k = 0;k < nz;++ k) 
+    for(int i = 0;i < nx;++ i) {
+      b.add_energy<pd::TriCorotEnergy>(stiff, vid(i, k), vid(i+1, k), vid(i+1, k+1));
+      b.add_energy<pd::TriCorotEnergy>(stiff, vid(i, k), vid(i+1, k+1), vid(i, k+1));
+    }
+}
+
+// Zero-length spring between two vertices (or between a vertex and a fixed 
+// point if v1 is not given), standing in for the per-step collision terms
+class SpringEnergy : public pd::ProjEnergy {
+ public:
+  SpringEnergy(pd::ProjDynBody* b0, size_t v0, pd::ProjDynBody* b1, size_t v1, real_t s) :
+      ProjEnergy(b0, s), b1_{b1}, v0_{v0}, v1_{v1} {}
+  SpringEnergy(pd::ProjDynBody* b0, size_t v0, const Vec3r& p, real_t s) :
+      ProjEnergy(b0, s), v0_{v0}, p_{p} {}
+
+  void project() override {}
+  [[nodiscard]] real_t val() const override { return 0; }
+
+  void register_global_solve_elems(pd::GlobalSolver* solver) override {
+    solver->add_elem(body_, v0_, stiffness_);
+    if ( b1_ ) {
+      solver->add_elem(b1_, v1_, stiffness_);
+      solver->add_elem(body_, v0_, b1_, v1_, -stiffness_);
+    }
+  }
+
+  void update_global_solve_rhs(pd::GlobalSolver* solver) override {
+    if ( !b1_ ) solver->add_rhs(body_, v0_, p_ * stiffness_);
+  }
+
+  void apply_global_solve_mat(pd::GlobalSolver* solver) const override {
+    const linalg::row4_r_t p0 = solver->mat_vec_in(body_, v0_);
+    if ( b1_ ) {
+      const linalg::row4_r_t p1 = solver->mat_vec_in(b1_, v1_);
+      solver->mat_vec_out(body_, v0_, (p0 - p1) * stiffness_);
+      solver->mat_vec_out(b1_, v1_, (p1 - p0) * stiffness_);
+    } else {
+      solver->mat_vec_out(body_, v0_, p0 * stiffness_);
+    }
+  }
+
+ private:
+  pd::ProjDynBody* b1_ {nullptr};
+  size_t v0_, v1_ {0};
+  Vec3r  p_;
+};
+
+// fill the RHS of the global system and solve it
+template <class Solver_>
+static void global_step(Solver_& solver, std::vector<pd::ProjDynBody>& bodies,
+                        const std::vector<std::unique_ptr<pd::ProjEnergy>>& cons = {}) {
+  solver.begin_solve();
+  for(auto const& b : bodies) {
+    for(auto const& pb : b.energy_batches()) {
+      for(size_t t = 0;t < pb->size();++ t) pb->update_global_solve_rhs(&solver, t);
+    }
+    for(auto const& e : b.internal_energies()) e->update_global_solve_rhs(&solver);
+  }
+  for(auto const& e : cons) e->update_global_solve_rhs(&solver);
+  solver.solve();
+}
+
+// The stiffness part of A annihilates rigid translations, so each row of A 
+// sums to the vertex mass when no vertex is restricted
+TEST(TestGlobalSolver, AssembleMatrix) {
+  std::vector<pd::ProjDynBody> bodies;
+  bodies.push_back(unit_cube_body(0));
+  add_cube_energies(bodies[0], 10.);
+
+  pd::GlbCholeskySolver solver;
+  solver.init(bodies, (real_t)1E-1);
+  ASSERT_EQ(solver.size(), 8);
+
+  const Eigen::MatrixXd A = Eigen::MatrixXd(solver.system_matrix().cast<double>());
+  EXPECT_NEAR((A - A.transpose()).norm(), 0., 1E-6);
+  for(Eigen::Index i = 0;i < A.rows();++ i) {
+    EXPECT_NEAR(A.row(i).sum(), 1., 1E-4);
+    EXPECT_GT(A(i, i), 1.);
+  }
+  // vertex 0 and 7 are not in the same tet
+  EXPECT_EQ(A(0, 7), 0.);
+  EXPECT_NE(A(0, 1), 0.);
+}
+
+TEST(TestGlobalSolver, CholeskyMatchesDense) {
+  std::vector<pd::ProjDynBody> bodies;
+  bodies.reserve(2);
+  bodies.push_back(unit_cube_body(1));
+  bodies.push_back(unit_cube_body(0));
+  for(auto& b : bodies) add_cube_energies(b, 10.);
+
+  pd::GlbCholeskySolver solver;
+  solver.init(bodies, (real_t)1E-2);
+  ASSERT_EQ(solver.size(), 15);
+
+  solver.begin_iter(bodies);
+  global_step(solver, bodies);
+
+  const Eigen::Matrix<double, Eigen::Dynamic, Eigen::Dynamic> A =
+      Eigen::MatrixXd(solver.system_matrix().cast<double>());
+  const Eigen::MatrixXd x = A.ldlt().solve(solver.rhs().cast<double>());
+  for(Eigen::Index i = 0;i < x.rows();++ i) {
+    for(Eigen::Index j = 0;j < 3;++ j) {
+      EXPECT_NEAR(solver.solution()(i, j), x(i, j), 1E-4);
+    }
+    // the padding column stays zero
+    EXPECT_EQ(solver.solution()(i, 3), (real_t)0);
+  }
+}
+
+// At the rest shape, the global step should keep every vertex in place
+TEST(TestGlobalSolver, CholeskyRestShape) {
+  std::vector<pd::ProjDynBody> bodies;
+  bodies.push_back(unit_cube_body(2));
+  add_cube_energies(bodies[0], 100.);
+
+  pd::GlbCholeskySolver solver;
+  solver.init(bodies, (real_t)1E-2);
+  solver.begin_iter(bodies);
+  global_step(solver, bodies);
+  solver.store_pos(bodies);
+
+  auto const& b = bodies[0];
+  for(size_t i = 0;i < b.num_vtx();++ i) {
+    EXPECT_NEAR(b.pred_pos(i).x(), b.vtx_pos(i).x(), 1E-4);
+    EXPECT_NEAR(b.pred_pos(i).y(), b.vtx_pos(i).y(), 1E-4);
+    EXPECT_NEAR(b.pred_pos(i).z(), b.vtx_pos(i).z(), 1E-4);
+  }
+}
+
+TEST(TestGlobalSolver, GaussSeidelMatchesCholesky) {
+  std::vector<pd::ProjDynBody> bodies;
+  bodies.reserve(2);
+  bodies.push_back(unit_cube_body(1));
+  bodies.push_back(unit_cube_body(0));
+  for(auto& b : bodies) add_cube_energies(b, 10.);
+
+  pd::GlbCholeskySolver chol;
+  chol.init(bodies, (real_t)1E-2);
+  chol.begin_iter(bodies);
+  global_step(chol, bodies);
+
+  pd::GlbGaussSeidelSolver gs(50);
+  gs.init(bodies, (real_t)1E-2);
+  // rows of the same color are never coupled, and each cube needs at least 
+  // as many colors as the vertices of a tet
+  EXPECT_GE(gs.num_colors(), 4);
+  EXPECT_LT(gs.num_colors(), 8);
+  gs.begin_iter(bodies);
+  global_step(gs, bodies);
+
+  for(Eigen::Index i = 0;i < chol.solution().rows();++ i) {
+    for(Eigen::Index j = 0;j < 3;++ j) {
+      EXPECT_NEAR(gs.solution()(i, j), chol.solution()(i, j), 1E-4);
+    }
+  }
+}
+
+// The collision terms are applied as a low-rank correction to the 
+// prefactored matrix, or by refactoring it if they involve too many vertices
+TEST(TestGlobalSolver, CholeskyCollisionTerms) {
+  std::vector<pd::ProjDynBody> bodies;
+  bodies.reserve(2);
+  bodies.push_back(unit_cube_body(1));
+  bodies.push_back(unit_cube_body(0));
+  for(auto& b : bodies) add_cube_energies(b, 10.);
+
+  std::vector<std::unique_ptr<pd::ProjEnergy>> cons;
+  cons.push_back(std::make_unique<SpringEnergy>(
+      &bodies[0], 3, Vec3r((real_t)0, (real_t)2, (real_t)0), (real_t)50));
+  cons.push_back(std::make_unique<SpringEnergy>(&bodies[0], 5, &bodies[1], 2, (real_t)20));
+  cons.push_back(std::make_unique<SpringEnergy>(&bodies[1], 2, &bodies[1], 6, (real_t)20));
+
+  pd::GlbCholeskySolver lowrank, refactor(2);
+  for(auto* solver : {&lowrank, &refactor}) {
+    solver->init(bodies, (real_t)1E-2);
+    solver->update_colli_terms(cons);
+    EXPECT_EQ(solver->num_colli_vtx(), 4);
+    solver->begin_iter(bodies);
+    global_step(*solver, bodies, cons);
+  }
+  EXPECT_FALSE(lowrank.refactored());
+  EXPECT_TRUE(refactor.refactored());
+  // the two softbodies are merged into one contact island
+  EXPECT_EQ(lowrank.num_blocks(), 2);
+  EXPECT_EQ(refactor.num_blocks(), 1);
+
+  const Eigen::MatrixXd A = Eigen::MatrixXd(lowrank.system_matrix(true).cast<double>());
+  const Eigen::MatrixXd x = A.ldlt().solve(lowrank.rhs().cast<double>());
+  for(Eigen::Index i = 0;i < x.rows();++ i) {
+    for(Eigen::Index j = 0;j < 3;++ j) {
+      EXPECT_NEAR(lowrank.solution()(i, j), x(i, j), 1E-4);
+      EXPECT_NEAR(refactor.solution()(i, j), x(i, j), 1E-4);
+    }
+  }
+
+  // without collisions, both fall back to the base matrix
+  cons.clear();
+  for(auto* solver : {&lowrank, &refactor}) {
+    solver->update_colli_terms(cons);
+    EXPECT_EQ(solver->num_colli_vtx(), 0);
+    EXPECT_FALSE(solver->refactored());
+    solver->begin_iter(bodies);
+    global_step(*solver, bodies);
+  }
+  const Eigen::MatrixXd A0 = Eigen::MatrixXd(lowrank.system_matrix().cast<double>());
+  const Eigen::MatrixXd x0 = A0.ldlt().solve(lowrank.rhs().cast<double>());
+  for(Eigen::Index i = 0;i < x0.rows();++ i) {
+    for(Eigen::Index j = 0;j < 3;++ j) {
+      EXPECT_NEAR(lowrank.solution()(i, j), x0(i, j), 1E-4);
+      EXPECT_NEAR(refactor.solution()(i, j), x0(i, j), 1E-4);
+    }
+  }
+}
+
+TEST(TestGlobalSolver, GaussSeidelCollisionTerms) {
+  std::vector<pd::ProjDynBody> bodies;
+  bodies.push_back(unit_cube_body(1));
+  add_cube_energies(bodies[0], 10.);
+
+  std::vector<std::unique_ptr<pd::ProjEnergy>> cons;
+  cons.push_back(std::make_unique<SpringEnergy>(
+      &bodies[0], 3, Vec3r((real_t)0, (real_t)2, (real_t)0), (real_t)50));
+  cons.push_back(std::make_unique<SpringEnergy>(
+      &bodies[0], 6, Vec3r((real_t)1, (real_t)1, (real_t)2), (real_t)50));
+
+  pd::GlbCholeskySolver chol;
+  chol.init(bodies, (real_t)1E-2);
+  chol.update_colli_terms(cons);
+  chol.begin_iter(bodies);
+  global_step(chol, bodies, cons);
+
+  pd::GlbGaussSeidelSolver gs(50);
+  gs.init(bodies, (real_t)1E-2);
+  gs.update_colli_terms(cons);
+  gs.begin_iter(bodies);
+  global_step(gs, bodies, cons);
+
+  for(Eigen::Index i = 0;i < chol.solution().rows();++ i) {
+    for(Eigen::Index j = 0;j < 3;++ j) {
+      EXPECT_NEAR(gs.solution()(i, j), chol.solution()(i, j), 1E-4);
+    }
+  }
+
+  // collision terms coupling two vertices are not supported
+  cons.push_back(std::make_unique<SpringEnergy>(&bodies[0], 5, &bodies[0], 2, (real_t)20));
+  EXPECT_THROW(gs.update_colli_terms(cons), std::runtime_error);
+}
+
+// Each softbody is an independent block, and only the contact islands
+// are refactored
+TEST(TestGlobalSolver, CholeskyBlocks) {
+  std::vector<pd::ProjDynBody> bodies;
+  bodies.reserve(4);
+  bodies.push_back(unit_cube_body(1));
+  bodies.push_back(unit_cube_body(8));  // fully fixed
+  bodies.push_back(unit_cube_body(0));
+  bodies.push_back(unit_cube_body(2));
+  for(auto& b : bodies) add_cube_energies(b, 10.);
+
+  pd::GlbCholeskySolver solver(1);
+  solver.init(bodies, (real_t)1E-2);
+  EXPECT_EQ(solver.num_blocks(), 3);
+
+  std::vector<std::unique_ptr<pd::ProjEnergy>> cons;
+  cons.push_back(std::make_unique<SpringEnergy>(&bodies[0], 5, &bodies[2], 2, (real_t)20));
+  solver.update_colli_terms(cons);
+  EXPECT_TRUE(solver.refactored());
+  EXPECT_EQ(solver.num_blocks(), 2);
+
+  solver.begin_iter(bodies);
+  global_step(solver, bodies, cons);
+  const Eigen::MatrixXd A = Eigen::MatrixXd(solver.system_matrix(true).cast<double>());
+  const Eigen::MatrixXd x = A.ldlt().solve(solver.rhs().cast<double>());
+  for(Eigen::Index i = 0;i < x.rows();++ i) {
+    for(Eigen::Index j = 0;j < 3;++ j) {
+      EXPECT_NEAR(solver.solution()(i, j), x(i, j), 1E-4);
+    }
+  }
+}
+
+// An island with unchanged collision terms keeps its factor, and one with 
+// changed values keeps its ordering
+TEST(TestGlobalSolver, CholeskyIslandReuse) {
+  std::vector<pd::ProjDynBody> bodies;
+  bodies.reserve(4);
+  bodies.push_back(unit_cube_body(1));
+  bodies.push_back(unit_cube_body(0));
+  bodies.push_back(unit_cube_body(2));
+  bodies.push_back(unit_cube_body(0));
+  for(auto& b : bodies) add_cube_energies(b, 10.);
+
+  pd::GlbCholeskySolver solver(1);
+  solver.init(bodies, (real_t)1E-2);
+  std::vector<std::unique_ptr<pd::ProjEnergy>> cons;
+  cons.push_back(std::make_unique<SpringEnergy>(&bodies[0], 5, &bodies[1], 2, (real_t)20));
+  cons.push_back(std::make_unique<SpringEnergy>(&bodies[2], 4, &bodies[3], 1, (real_t)20));
+  solver.update_colli_terms(cons);
+  EXPECT_EQ(solver.num_factored_islands(), 2);
+  solver.update_colli_terms(cons);
+  EXPECT_EQ(solver.num_factored_islands(), 0);
+
+  // the second island changes its values, then its pattern
+  cons[1] = std::make_unique<SpringEnergy>(&bodies[2], 4, &bodies[3], 1, (real_t)40);
+  solver.update_colli_terms(cons);
+  EXPECT_EQ(solver.num_factored_islands(), 1);
+  cons[1] = std::make_unique<SpringEnergy>(&bodies[2], 3, &bodies[3], 1, (real_t)40);
+  solver.update_colli_terms(cons);
+  EXPECT_EQ(solver.num_factored_islands(), 1);
+  // a new dt^2 changes all values
+  solver.refactor((real_t)2E-2);
+  EXPECT_EQ(solver.num_factored_islands(), 2);
+
+  solver.begin_iter(bodies);
+  global_step(solver, bodies, cons);
+  const Eigen::MatrixXd A = Eigen::MatrixXd(solver.system_matrix(true).cast<double>());
+  const Eigen::MatrixXd x = A.ldlt().solve(solver.rhs().cast<double>());
+  for(Eigen::Index i = 0;i < x.rows();++ i) {
+    for(Eigen::Index j = 0;j < 3;++ j) {
+      EXPECT_NEAR(solver.solution()(i, j), x(i, j), 1E-4);
+    }
+  }
+}
+
+TEST(TestGlobalSolver, PCGMatchesCholesky) {
+  std::vector<pd::ProjDynBody> bodies;
+  bodies.reserve(2);
+  bodies.push_back(unit_cube_body(1));
+  bodies.push_back(unit_cube_body(0));
+  for(auto& b : bodies) add_cube_energies(b, 100.);
+
+  std::vector<std::unique_ptr<pd::ProjEnergy>> cons;
+  cons.push_back(std::make_unique<SpringEnergy>(
+      &bodies[0], 3, Vec3r((real_t)0, (real_t)2, (real_t)0), (real_t)50));
+  cons.push_back(std::make_unique<SpringEnergy>(&bodies[0], 5, &bodies[1], 2, (real_t)20));
+
+  pd::GlbCholeskySolver chol;
+  chol.init(bodies, (real_t)1E-2);
+  chol.update_colli_terms(cons);
+  chol.begin_iter(bodies);
+  global_step(chol, bodies, cons);
+
+  uint32_t iters[2];
+  for(auto pc : {pd::GlbPCGSolver::Precond::JACOBI, pd::GlbPCGSolver::Precond::IC0}) {
+    pd::GlbPCGSolver pcg(pc, 100, (real_t)1E-6);
+    pcg.init(bodies, (real_t)1E-2);
+    pcg.update_colli_terms(cons);
+    pcg.begin_iter(bodies);
+    global_step(pcg, bodies, cons);
+    iters[static_cast<int>(pc)] = pcg.last_iters();
+    EXPECT_LT(pcg.last_iters(), 100);
+
+    for(Eigen::Index i = 0;i < chol.solution().rows();++ i) {
+      for(Eigen::Index j = 0;j < 3;++ j) {
+        EXPECT_NEAR(pcg.solution()(i, j), chol.solution()(i, j), 1E-4);
+      }
+      EXPECT_EQ(pcg.solution()(i, 3), (real_t)0);
+    }
+
+    // warm start from the solution: no more iteration is needed
+    global_step(pcg, bodies, cons);
+    EXPECT_LE(pcg.last_iters(), 1);
+  }
+  EXPECT_LE(iters[1], iters[0]);
+
+  // the matrix-free mode follows the same iterations as the assembled one
+  pd::GlbPCGSolver mf(pd::GlbPCGSolver::Precond::JACOBI, 100, (real_t)1E-6, true);
+  mf.init(bodies, (real_t)1E-2);
+  mf.update_colli_terms(cons);
+  mf.begin_iter(bodies);
+  global_step(mf, bodies, cons);
+  EXPECT_NEAR(mf.last_iters(), iters[0], 1);
+  for(Eigen::Index i = 0;i < chol.solution().rows();++ i) {
+    for(Eigen::Index j = 0;j < 3;++ j) {
+      EXPECT_NEAR(mf.solution()(i, j), chol.solution()(i, j), 1E-4);
+    }
+  }
+  EXPECT_THROW(pd::GlbPCGSolver(pd::GlbPCGSolver::Precond::IC0, 100, (real_t)1E-6, true), 
+               std::invalid_argument);
+}
+
+TEST(TestGlobalSolver, MultigridMatchesCholesky) {
+  std::vector<pd::ProjDynBody> bodies;
+  add_grid_body(bodies, 8, 4, 4, 1E3);
+
+  // move the free vertices, so the global step has to pull them back
+  bodies[0].predict_vel_pos(Vec3r((real_t)0, (real_t)-100, (real_t)0), (real_t)0.1);
+
+  pd::GlbCholeskySolver chol;
+  chol.init(bodies, (real_t)1E-2);
+  chol.begin_iter(bodies);
+  global_step(chol, bodies);
+
+  pd::GlbMultigridSolver mg(2, 2, 16);
+  mg.init(bodies, (real_t)1E-2);
+  ASSERT_GE(mg.num_levels(), 2);
+  EXPECT_EQ(mg.level_size(0), 200);
+  for(size_t l = 1;l < mg.num_levels();++ l) {
+    EXPECT_LT(mg.level_size(l) * 2, mg.level_size(l-1));
+  }
+  EXPECT_LE(mg.level_size(mg.num_levels() - 1), 16);
+
+  mg.begin_iter(bodies);
+  auto const error = [&]() { 
+    return (mg.solution() - chol.solution()).cwiseAbs().maxCoeff(); 
+  };
+  auto const e0 = error();
+  // the solves are warm-started from the previous ones
+  for(int i = 0;i < 10;++ i) global_step(mg, bodies);
+  EXPECT_LT(error(), e0 * (real_t)1E-3);
+  EXPECT_LT(error(), 1E-3);
+}
+
+TEST(TestGlobalSolver, MixedPrecisionRefinement) {
+  std::vector<pd::ProjDynBody> bodies;
+  add_grid_body(bodies, 6, 3, 3, 1E4);
+  bodies[0].predict_vel_pos(Vec3r((real_t)0, (real_t)-100, (real_t)0), (real_t)0.1);
+
+  double err[3], xmax = 0;
+  for(uint32_t n = 0;n < 3;++ n) {
+    pd::GlbMixedCholeskySolver mixed(n);
+    mixed.init(bodies, (real_t)1E-2);
+    mixed.begin_iter(bodies);
+    global_step(mixed, bodies);
+
+    // the reference solution of the same system in double
+    const Eigen::MatrixXd A = Eigen::MatrixXd(mixed.system_matrix().cast<double>());
+    const Eigen::MatrixXd x = A.ldlt().solve(mixed.rhs().cast<double>());
+    err[n] = (mixed.solution().cast<double>() - x).leftCols(3).cwiseAbs().maxCoeff();
+    xmax = x.cwiseAbs().maxCoeff();
+  }
+  EXPECT_LT(err[0], 1E-3);
+  // in float, a single step already reaches the rounding of the result
+  if constexpr (sizeof(real_t) == sizeof(double)) EXPECT_LT(err[1], err[0] * 1E-2);
+  EXPECT_LE(err[2], err[1]);
+  // the refinement recovers the precision of real_t in both builds
+  constexpr double eps = std::numeric_limits<real_t>::epsilon();
+  EXPECT_LT(err[2], 16 * eps * xmax);
+}
+
+// refactor() to a new dt^2 gives the same system, and the same solution, as 
+// a fresh init() with it
+template <class Make_>
+static void check_refactor(Make_ make, int nsolves, double tol) {
+  std::vector<pd::ProjDynBody> bodies;
+  add_grid_body(bodies, 4, 2, 2, 1E3);
+  bodies[0].predict_vel_pos(Vec3r((real_t)0, (real_t)-100, (real_t)0), (real_t)0.1);
+  std::vector<std::unique_ptr<pd::ProjEnergy>> cons;
+  cons.push_back(std::make_unique<SpringEnergy>(
+      &bodies[0], 44, Vec3r((real_t)5, (real_t)2, (real_t)2), (real_t)50));
+
+  auto solver = make();
+  solver.init(bodies, (real_t)1E-2);
+  solver.update_colli_terms(cons);
+  solver.refactor((real_t)4E-2);
+  EXPECT_EQ(solver.dt2(), (real_t)4E-2);
+
+  auto fresh = make();
+  fresh.init(bodies, (real_t)4E-2);
+  fresh.update_colli_terms(cons);
+  const Eigen::MatrixXd A = Eigen::MatrixXd(fresh.system_matrix(true).template cast<double>());
+  const Eigen::MatrixXd A1 = Eigen::MatrixXd(solver.system_matrix(true).template cast<double>());
+  EXPECT_NEAR((A - A1).cwiseAbs().maxCoeff(), 0., 1E-4);
+
+  solver.begin_iter(bodies);
+  fresh.begin_iter(bodies);
+  for(int i = 0;i < nsolves;++ i) {
+    global_step(solver, bodies, cons);
+    global_step(fresh, bodies, cons);
+  }
+  const Eigen::MatrixXd x = A.ldlt().solve(fresh.rhs().template cast<double>());
+  for(Eigen::Index i = 0;i < x.rows();++ i) {
+    for(Eigen::Index j = 0;j < 3;++ j) {
+      EXPECT_NEAR(solver.solution()(i, j), x(i, j), tol);
+      EXPECT_NEAR(solver.solution()(i, j), fresh.solution()(i, j), tol);
+    }
+  }
+}
+
+TEST(TestGlobalSolver, RefactorTimestep) {
+  check_refactor([]() { return pd::GlbCholeskySolver(); }, 1, 1E-4);
+  check_refactor([]() { return pd::GlbCholeskySolver(0); }, 1, 1E-4);
+  check_refactor([]() { return pd::GlbMixedCholeskySolver(2); }, 1, 1E-4);
+  check_refactor([]() { return pd::GlbPCGSolver(pd::GlbPCGSolver::Precond::IC0, 200, 1E-6); }, 
+                 1, 1E-3);
+  check_refactor([]() { return pd::GlbMultigridSolver(2, 2, 16); }, 10, 1E-3);
+  check_refactor([]() { return pd::GlbGaussSeidelSolver(); }, 20, 1E-3);
+  check_refactor([]() { return pd::GlbSchurSolver(4); }, 1, 1E-4);
+}
+
+TEST(TestGlobalSolver, SchurMatchesCholesky) {
+  std::vector<pd::ProjDynBody> bodies;
+  add_grid_body(bodies, 12, 3, 3, 1E3);
+  bodies[0].predict_vel_pos(Vec3r((real_t)0, (real_t)-100, (real_t)0), (real_t)0.1);
+  std::vector<std::unique_ptr<pd::ProjEnergy>> cons;
+  cons.push_back(std::make_unique<SpringEnergy>(
+      &bodies[0], 100, Vec3r((real_t)6, (real_t)2, (real_t)2), (real_t)50));
+
+  pd::GlbCholeskySolver chol;
+  chol.init(bodies, (real_t)1E-2);
+  pd::GlbSchurSolver schur(4);
+  schur.init(bodies, (real_t)1E-2);
+  EXPECT_EQ(schur.num_parts(), 4);
+  // 3 cuts across the bar, each of at most 2 layers of 16 vertices
+  EXPECT_GT(schur.interface_size(), 0);
+  EXPECT_LE(schur.interface_size(), 3 * 16 * 2);
+  // the first and the last cut are not coupled, so S is not dense
+  auto const m = schur.interface_size();
+  EXPECT_LT(schur.schur_nonzeros(), m * (m + 1) / 2);
+
+  auto const check = [&]() {
+    for(Eigen::Index i = 0;i < (Eigen::Index)chol.size();++ i) {
+      for(Eigen::Index j = 0;j < 3;++ j) {
+        EXPECT_NEAR(schur.solution()(i, j), chol.solution()(i, j), 1E-4);
+      }
+    }
+  };
+  for(auto* solver : std::initializer_list<pd::GlobalSolver*>{&chol, &schur}) {
+    solver->begin_iter(bodies);
+    global_step(*solver, bodies);
+  }
+  check();
+
+  // the collision terms on the diagonal refactor the affected parts
+  for(auto* solver : std::initializer_list<pd::GlobalSolver*>{&chol, &schur}) {
+    solver->update_colli_terms(cons);
+    global_step(*solver, bodies, cons);
+  }
+  check();
+}
+
+TEST(TestGlobalSolver, ParallelRhsAssembly) {
+  std::vector<pd::ProjDynBody> bodies;
+  bodies.reserve(2);
+  add_grid_body(bodies, 10, 4, 4, 1E3);
+  add_grid_body(bodies, 3, 2, 2, 1E2);
+  for(auto& b : bodies) {
+    b.predict_vel_pos(Vec3r((real_t)0, (real_t)-100, (real_t)0), (real_t)0.1);
+    b.project();
+  }
+  std::vector<std::unique_ptr<pd::ProjEnergy>> cons;
+  cons.push_back(std::make_unique<SpringEnergy>(
+      &bodies[0], 100, Vec3r((real_t)6, (real_t)2, (real_t)2), (real_t)50));
+
+  pd::GlbCholeskySolver solver;
+  solver.init(bodies, (real_t)1E-2);
+  solver.begin_iter(bodies);
+
+  // reference: the serial loop over all energies
+  solver.begin_solve();
+  for(auto const& b : bodies) {
+    for(auto const& pb : b.energy_batches()) {
+      for(size_t t = 0;t < pb->size();++ t) pb->update_global_solve_rhs(&solver, t);
+    }
+    for(auto const& e : b.internal_energies()) e->update_global_solve_rhs(&solver);
+  }
+  for(auto const& e : cons) e->update_global_solve_rhs(&solver);
+  const linalg::matrix_x4_r_t b0 = solver.rhs();
+
+  // the tet energies are gathered by the RHS operator, and the springs are
+  // scattered
+  solver.begin_solve();
+  solver.assemble_rhs(cons);
+  const linalg::matrix_x4_r_t b1 = solver.rhs();
+  EXPECT_LT((b1 - b0).cwiseAbs().maxCoeff(), 1E-3 * b0.cwiseAbs().maxCoeff());
+
+  // the coloring fixes the order of the sums on each row
+  solver.begin_solve();
+  solver.assemble_rhs(cons);
+  EXPECT_EQ(solver.rhs(), b1);
+}
+
+TEST(TestGlobalSolver, BindPositions) {
+  std::vector<pd::ProjDynBody> bodies;
+  add_grid_body(bodies, 4, 2, 2, 1E3);
+  auto& b = bodies[0];
+  auto const r = b.num_restricted_vs();
+  b.predict_vel_pos(Vec3r((real_t)0, (real_t)-100, (real_t)0), (real_t)0.1);
+
+  // reference: copy the positions in and out
+  pd::GlbCholeskySolver ref;
+  ref.init(bodies, (real_t)1E-2);
+  ref.begin_iter(bodies);
+  global_step(ref, bodies);
+
+  pd::GlbCholeskySolver solver;
+  solver.init(bodies, (real_t)1E-2);
+  solver.bind_pos(bodies);
+  if constexpr (sizeof(Vec3r) == sizeof(linalg::row4_r_t)) {
+    ASSERT_TRUE(solver.is_bound(b));
+    EXPECT_EQ(static_cast<const void*>(&b.pred_pos(r)), solver.solution().data());
+  } else {
+    EXPECT_FALSE(solver.is_bound(b));
+  }
+  EXPECT_EQ(b.pred_pos(r + 1).y(), solver.solution()(1, 1));
+
+  solver.begin_iter(bodies);
+  global_step(solver, bodies);
+  solver.store_pos(bodies);
+  for(size_t i = 0;i < b.num_free_vs();++ i) {
+    EXPECT_NEAR(b.pred_pos(r + i).y(), ref.solution()(i, 1), 1E-5);
+  }
+
+  // the positions stay with the softbody
+  solver.unbind_pos(bodies);
+  EXPECT_FALSE(solver.is_bound(b));
+  for(size_t i = 0;i < b.num_free_vs();++ i) {
+    EXPECT_NEAR(b.pred_pos(r + i).y(), ref.solution()(i, 1), 1E-5);
+  }
+}
+
+TEST(TestGlobalSolver, JacobiMatchesCholesky) {
+  std::vector<pd::ProjDynBody> bodies;
+  bodies.reserve(2);
+  add_grid_body(bodies, 4, 2, 2, 1E3);
+  add_grid_body(bodies, 2, 2, 2, 1E3);
+  for(auto& b : bodies) {
+    b.predict_vel_pos(Vec3r((real_t)0, (real_t)-100, (real_t)0), (real_t)0.1);
+  }
+  std::vector<std::unique_ptr<pd::ProjEnergy>> cons;
+  cons.push_back(std::make_unique<SpringEnergy>(
+      &bodies[0], 44, Vec3r((real_t)5, (real_t)2, (real_t)2), (real_t)50));
+  cons.push_back(std::make_unique<SpringEnergy>(&bodies[0], 40, &bodies[1], 26, (real_t)20));
+
+  pd::GlbCholeskySolver chol;
+  pd::GlbJacobiSolver jacobi(50);
+  for(auto* solver : std::initializer_list<pd::GlobalSolver*>{&chol, &jacobi}) {
+    solver->init(bodies, (real_t)1E-2);
+    solver->update_colli_terms(cons);
+    solver->begin_iter(bodies);
+  }
+  global_step(chol, bodies, cons);
+
+  auto const error = [&]() { 
+    return (jacobi.solution() - chol.solution()).cwiseAbs().maxCoeff(); 
+  };
+  auto const e0 = error();
+  // the solves are warm-started from the previous ones
+  for(int i = 0;i < 20;++ i) global_step(jacobi, bodies, cons);
+  EXPECT_LT(error(), e0 * (real_t)1E-3);
+  EXPECT_LT(error(), 1E-3);
+}
+
+// cloth through the PD path: the gathered RHS of the triangle batch matches
+// the per-term RHS, and the matrix-free product matches the assembled matrix
+TEST(TestGlobalSolver, TriCorotEnergies) {
+  std::vector<pd::ProjDynBody> bodies;
+  add_sheet_body(bodies, 6, 5, 1E3);
+  ASSERT_EQ(bodies[0].energy_batches().size(), 1);
+  ASSERT_EQ(bodies[0].energy_batches()[0]->size(), 60);
+  bodies[0].predict_vel_pos(Vec3r((real_t)0, (real_t)-100, (real_t)0), (real_t)0.1);
+  bodies[0].project();
+
+  pd::GlbCholeskySolver chol;
+  chol.init(bodies, (real_t)1E-2);
+  ASSERT_EQ(chol.size(), 35);
+  chol.begin_iter(bodies);
+  global_step(chol, bodies);
+  const linalg::matrix_x4_r_t b0 = chol.rhs();
+  const linalg::matrix_x4_r_t x0 = chol.solution();
+
+  chol.begin_solve();
+  chol.assemble_rhs(std::vector<std::unique_ptr<pd::ProjEnergy>>{});
+  EXPECT_LT((chol.rhs() - b0).cwiseAbs().maxCoeff(), 1E-3 * b0.cwiseAbs().maxCoeff());
+
+  // the sheet is pulled back up from the predicted positions
+  for(Eigen::Index i = 0;i < x0.rows();++ i) {
+    EXPECT_GT(x0(i, 1), -1.);
+    EXPECT_LT(x0(i, 1), 0.);
+  }
+
+  pd::GlbPCGSolver mf(pd::GlbPCGSolver::Precond::JACOBI, 200, (real_t)1E-7, true);
+  mf.init(bodies, (real_t)1E-2);
+  mf.begin_iter(bodies);
+  global_step(mf, bodies);
+  EXPECT_LT(mf.last_iters(), 200);
+  for(Eigen::Index i = 0;i < x0.rows();++ i) {
+    for(Eigen::Index j = 0;j < 3;++ j) {
+      EXPECT_NEAR(mf.solution()(i, j), x0(i, j), 1E-3);
+    }
+  }
+}
+
+// the matrix-free product runs in parallel over the colored energies
+TEST(TestGlobalSolver, MatrixFreeLargeBody) {
+  std::vector<pd::ProjDynBody> bodies;
+  add_grid_body(bodies, 10, 4, 4, 1E3);
+  bodies[0].predict_vel_pos(Vec3r((real_t)0, (real_t)-100, (real_t)0), (real_t)0.1);
+  bodies[0].project();
+
+  pd::GlbCholeskySolver chol;
+  chol.init(bodies, (real_t)1E-2);
+  chol.begin_iter(bodies);
+  global_step(chol, bodies);
+
+  pd::GlbPCGSolver mf(pd::GlbPCGSolver::Precond::JACOBI, 500, (real_t)1E-7, true);
+  mf.init(bodies, (real_t)1E-2);
+  mf.begin_iter(bodies);
+  global_step(mf, bodies);
+  EXPECT_LT(mf.last_iters(), 500);
+  for(Eigen::Index i = 0;i < chol.solution().rows();++ i) {
+    for(Eigen::Index j = 0;j < 3;++ j) {
+      EXPECT_NEAR(mf.solution()(i, j), chol.solution()(i, j), 1E-3);
+    }
+  }
+}
@@ -0,0 +1,118 @@
+//******************************************************************************
+// test_iter_accel.cpp -- This file is part of Doux, a realtime softbody simulation library
+//
+// Copyright (C) 2021 Changxi Zheng <cxz@cs.columbia.edu>
+//
+// This Source Code Form is subject to the terms of the Mozilla Public License
+// v. 2.0. If a copy of the MPL was not distributed with this file, You can
+// obtain one at http://mozilla.org/MPL/2.0/.
+//******************************************************************************
+#include <gtest/gtest.h>
+
+#include "common.h"
+#include "doux/pd/iter_accel.h"
+
+using namespace doux;
+
+// A slowly converging linear fixed-point iteration (Jacobi iteration on
+// a 1D Laplacian-like system) used in place of the local/global iteration
+struct JacobiIter {
+  explicit JacobiIter(Eigen::Index n) : b(n, 4) {
+    for(Eigen::Index i = 0;i < n;++ i) {
+      b.row(i) << (real_t)1, (real_t)(i % 3), (real_t)-0.5, (real_t)0;
+    }
+  }
+
+  // diag: 2.2, off-diag: -1
+  void operator()(linalg::matrix_x4_r_t& x) const {
+    linalg::matrix_x4_r_t y = b;
+    auto const n = x.rows();
+    y.topRows(n - 1) += x.bottomRows(n - 1);
+    y.bottomRows(n - 1) += x.topRows(n - 1);
+    x = y / (real_t)2.2;
+  }
+
+  [[nodiscard]] real_t residual(const linalg::matrix_x4_r_t& x) const {
+    linalg::matrix_x4_r_t r = b - (real_t)2.2 * x;
+    auto const n = x.rows();
+    r.topRows(n - 1) += x.bottomRows(n - 1);
+    r.bottomRows(n - 1) += x.topRows(n - 1);
+    return r.norm();
+  }
+
+  linalg::matrix_x4_r_t b;
+};
+
+static real_t run_cheby(pd::ChebyshevAccel& acc, const JacobiIter& it, size_t niter) {
+  linalg::matrix_x4_r_t x = linalg::matrix_x4_r_t::Zero(it.b.rows(), 4);
+  acc.begin(x);
+  for(size_t i = 0;i < niter;++ i) {
+    it(x);
+    acc.update(x);
+  }
+  acc.end();
+  return it.residual(x);
+}
+
+TEST(TestIterAccel, ChebyshevWarmup) {
+  JacobiIter it(40);
+  pd::ChebyshevAccel acc;
+  EXPECT_TRUE(acc.warming_up());
+
+  // the spectral radius of the Jacobi iteration is 2cos(pi/41)/2.2
+  run_cheby(acc, it, 60);
+  EXPECT_FALSE(acc.warming_up());
+  EXPECT_NEAR(acc.rho(), 2. * std::cos(M_PI / 41.) / 2.2, 1E-2);
+}
+
+TEST(TestIterAccel, ChebyshevConvergence) {
+  JacobiIter it(40);
+  linalg::matrix_x4_r_t x = linalg::matrix_x4_r_t::Zero(40, 4);
+  for(int i = 0;i < 30;++ i) it(x);
+  auto const plain = it.residual(x);
+
+  pd::ChebyshevAccel acc((real_t)(2. * std::cos(M_PI / 41.) / 2.2), (real_t)1, 2);
+  EXPECT_FALSE(acc.warming_up());
+  auto const accel = run_cheby(acc, it, 30);
+  EXPECT_LT(accel, plain * 0.1);
+}
+
+TEST(TestIterAccel, AndersonConvergence) {
+  JacobiIter it(40);
+  linalg::matrix_x4_r_t x = linalg::matrix_x4_r_t::Zero(40, 4);
+  for(int i = 0;i < 20;++ i) it(x);
+  auto const plain = it.residual(x);
+
+  pd::AndersonAccel acc(5);
+  x.setZero();
+  acc.begin(x);
+  for(int i = 0;i < 20;++ i) {
+    it(x);
+    acc.update(x);
+  }
+  EXPECT_LT(it.residual(x), plain * 0.01);
+}
+
+TEST(TestIterAccel, AndersonSafeguard) {
+  JacobiIter it(10);
+  linalg::matrix_x4_r_t x = linalg::matrix_x4_r_t::Zero(10, 4);
+
+  pd::AndersonAccel acc(2);
+  acc.begin(x);
+  // plain iterates are always accepted
+  EXPECT_TRUE(acc.accept((real_t)1));
+  it(x);
+  acc.update(x);
+  EXPECT_TRUE(acc.accept((real_t)2));
+
+  it(x);
+  const linalg::matrix_x4_r_t g = x;
+  acc.update(x);  // extrapolated
+  EXPECT_FALSE(acc.accept((real_t)3));
+  EXPECT_EQ(acc.num_rejected(), 1);
+
+  // fall back to the plain iterate G(q^k)
+  x = acc.fallback();
+  EXPECT_EQ(x, g);
+  EXPECT_TRUE(acc.accept((real_t)4));
+}
@@ -8,6 +8,9 @@
 // obtain one at http://mozilla.org/MPL/2.0/.
 //******************************************************************************
 #include <gtest/gtest.h>
+#include <algorithm>
+#include <numeric>
+#include <random>
 
 #include "common.h"
 #include "doux/pd/motion_preset.h"
@@ -183,4 +186,67 @@ TEST(TestPDMotionPreset, FixedSetup5) {
   EXPECT_APPROX_EQ(vp.x(), 0);
   EXPECT_APPROX_EQ(vp.y(), 2);
   EXPECT_APPROX_EQ(vp.z(), 1);
-}
\ No newline at end of file
+}
+
+// maximal difference of the vertex IDs in an element, ignoring the
+// first nskip (i.e., restricted) vertices
+static size_t mesh_bandwidth(const doux::linalg::matrix_i_t& e, int nskip = 0) {
+  size_t bw = 0;
+  for(Eigen::Index i = 0;i < e.rows();++ i) {
+    for(Eigen::Index j = 0;j < e.cols();++ j) {
+      for(Eigen::Index k = 0;k < e.cols();++ k) {
+        if ( e(i, j) < nskip || e(i, k) < nskip ) continue;
+        bw = std::max<size_t>(bw, std::abs(e(i, j) - e(i, k)));
+      }
+    }
+  }
+  return bw;
+}
+
+TEST(TestPDMotionPreset, RCMOrder) {
+  using namespace doux;
+
+  // a 16 x 4 grid of vertices, triangulated and shuffled
+  constexpr int NX = 16, NY = 4;
+  std::vector<uint32_t> perm(NX * NY);
+  std::iota(perm.begin(), perm.end(), 0);
+  std::shuffle(perm.begin(), perm.end(), std::mt19937(7));
+
+  linalg::matrix_r_t x(NX * NY, 3);
+  for(int i = 0;i < NX;++ i) {
+    for(int j = 0;j < NY;++ j) x.row(perm[i*NY + j]) << (real_t)i, (real_t)j, (real_t)0;
+  }
+  linalg::matrix_i_t e(2 * (NX-1) * (NY-1), 3);
+  int k = 0;
+  for(int i = 0;i + 1 < NX;++ i) {
+    for(int j = 0;j + 1 < NY;++ j) {
+      auto const v = [&](int a, int b) { return (int)perm[(i+a)*NY + j+b]; };
+      e.row(k ++) << v(0, 0), v(1, 0), v(1, 1);
+      e.row(k ++) << v(0, 0), v(1, 1), v(0, 1);
+    }
+  }
+  shape::Mesh<2> msh(std::move(x), std::move(e));
+
+  pd::MotionPreset<2> preset(msh);
+  EXPECT_FALSE(preset.reorder_vertices());
+  auto const vid = preset.reorder_vertices(pd::VtxOrder::RCM).value();
+  ASSERT_EQ(vid.size(), NX * NY);
+  EXPECT_TRUE(std::is_permutation(vid.begin(), vid.end(), perm.begin()));
+
+  auto [rmsh, inv] = pd::internal::ordered_mesh(vid, msh);
+  EXPECT_GT(mesh_bandwidth(msh.elements()), 2 * NY);
+  EXPECT_LE(mesh_bandwidth(rmsh.elements()), NY + 1);
+
+  // the fixed vertices stay at the beginning
+  preset.fix_vertex(perm[0]);
+  preset.fix_vertex(perm[1]);
+  auto const vid2 = preset.reorder_vertices(pd::VtxOrder::RCM).value();
+  EXPECT_EQ(vid2[0], std::min(perm[0], perm[1]));
+  EXPECT_EQ(vid2[1], std::max(perm[0], perm[1]));
+  EXPECT_TRUE(std::is_permutation(vid2.begin(), vid2.end(), perm.begin()));
+
+  auto [sb, optmsh] = pd::build_softbody(preset, pd::VtxOrder::RCM);
+  ASSERT_TRUE(optmsh);
+  EXPECT_EQ(sb.num_fixed_vs(), 2);
+  EXPECT_LE(mesh_bandwidth(optmsh.value().elements(), 2), NY + 1);
+}
@@ -0,0 +1,99 @@
+//******************************************************************************
+// test_parallel.cpp -- This file is part of Doux, a realtime softbody simulation library
+//
+// Copyright (C) 2021 Changxi Zheng <cxz@cs.columbia.edu>
+//
+// This Source Code Form is subject to the terms of the Mozilla Public License
+// v. 2.0. If a copy of the MPL was not distributed with this file, You can
+// obtain one at http://mozilla.org/MPL/2.0/.
+//******************************************************************************
+#include <gtest/gtest.h>
+#include <chrono>
+#include <numeric>
+#include <stdexcept>
+
+#include "doux/core/parallel.h"
+
+TEST(TestParallel, ParallelFor) {
+  using namespace doux;
+
+  ThreadPool pool(4);
+  EXPECT_EQ(pool.num_threads(), 4);
+
+  std::vector<int> v(10007, 0);
+  for(int k = 0;k < 20;++ k) {
+    pool.parallel_for(v.size(), 64, [&](size_t b, size_t e) {
+      for(size_t i = b;i < e;++ i) v[i] += static_cast<int>(i % 7);
+    });
+  }
+
+  for(size_t i = 0;i < v.size();++ i) {
+    ASSERT_EQ(v[i], 20 * static_cast<int>(i % 7));
+  }
+}
+
+TEST(TestParallel, NestedParallelFor) {
+  using namespace doux;
+
+  std::atomic<size_t> cnt {0};
+  parallel_for(100, 10, [&](size_t b, size_t e) {
+    for(size_t i = b;i < e;++ i) {
+      parallel_for(50, 5, [&](size_t s, size_t t) { cnt += t - s; });
+    }
+  });
+  EXPECT_EQ(cnt.load(), 5000);
+}
+
+TEST(TestParallel, UnbalancedChunks) {
+  using namespace doux;
+
+  // the chunks at the front are much more expensive, so the threads that own
+  // the back ranges have to steal them
+  set_num_threads(4);
+  EXPECT_EQ(thread_pool().num_threads(), 4);
+  std::vector<std::atomic<int>> hits(997);
+  std::atomic<size_t> sum {0};
+  parallel_for(hits.size(), 3, [&](size_t b, size_t e) {
+    for(size_t i = b;i < e;++ i) {
+      ++ hits[i];
+      if ( i < 100 ) std::this_thread::sleep_for(std::chrono::microseconds(50));
+      sum += i;
+    }
+  });
+  for(auto const& h : hits) ASSERT_EQ(h.load(), 1);
+  EXPECT_EQ(sum.load(), hits.size() * (hits.size() - 1) / 2);
+
+  set_num_threads(1);
+  EXPECT_EQ(thread_pool().num_threads(), 1);
+  set_num_threads(0);
+}
+
+TEST(TestParallel, ExceptionInLoopBody) {
+  using namespace doux;
+
+  ThreadPool pool(4);
+  std::atomic<size_t> cnt {0};
+  EXPECT_THROW(pool.parallel_for(1000, 10, [&](size_t b, size_t e) {
+    if ( b <= 500 && 500 < e ) throw std::runtime_error("failed chunk");
+    cnt += e - b;
+  }), std::runtime_error);
+  EXPECT_LT(cnt.load(), 1000);
+
+  // every chunk throws, including the ones of the calling thread
+  EXPECT_THROW(pool.parallel_for(1000, 10, [](size_t, size_t) {
+    throw std::runtime_error("failed chunk");
+  }), std::runtime_error);
+
+  // the pool is still usable, and the loops are split into chunks again 
+  // (i.e., the calling thread is not left marked as running a loop body)
+  std::vector<int> v(1000, 0);
+  std::atomic<size_t> nchunks {0};
+  pool.parallel_for(v.size(), 10, [&](size_t b, size_t e) {
+    for(size_t i = b;i < e;++ i) v[i] = static_cast<int>(i);
+    ++ nchunks;
+  });
+  EXPECT_EQ(nchunks.load(), 100);
+  for(size_t i = 0;i < v.size();++ i) {
+    ASSERT_EQ(v[i], static_cast<int>(i));
+  }
+}
@@ -0,0 +1,261 @@
+//******************************************************************************
+// test_sim.cpp -- This file is part of Doux, a realtime softbody simulation library
+//
+// Copyright (C) 2021 Changxi Zheng <cxz@cs.columbia.edu>
+//
+// This Source Code Form is subject to the terms of the Mozilla Public License
+// v. 2.0. If a copy of the MPL was not distributed with this file, You can
+// obtain one at http://mozilla.org/MPL/2.0/.
+//******************************************************************************
+#include <gtest/gtest.h>
+
+#include "common.h"
+#include "doux/core/parallel.h"
+#include "doux/pd/scene.h"
+#include "doux/pd/sim.h"
+#include "doux/pd/force.h"
+#include "doux/pd/global_solver.h"
+#include "doux/shape/tet.h"
+
+using namespace doux;
+
+using TestSim = pd::ProjDynSim<pd::ProjDynScene<>, pd::GlbCholeskySolver, pd::MassForce>;
+
+// A bar of nx unit cubes (5 tets each) along the x-axis, with the 4 vertices 
+// at x = 0 fixed. If scripted, vertex 3 at (0, 1, 1) moves along z with unit 
+// speed instead. The whole bar is translated by (shift, shift, shift).
+static pd::ProjDynScene<> bar_scene(int nx, real_t stiff, bool scripted = false, 
+                                    real_t shift = 0) {
+  std::vector<Vec3r> ps;
+  for(int i = 0;i <= nx;++ i) {
+    for(int j = 0;j < 4;++ j) {
+      ps.emplace_back((real_t)i + shift, (real_t)(j & 1) + shift, (real_t)((j >> 1) & 1) + shift);
+    }
+  }
+  linalg::matrix_i_t fs(1, 3);
+  fs << 0, 1, 2;
+
+  std::vector<Vec3r> p0;
+  std::vector<pd::MotiveBody::MotionFunc> script;
+  if ( scripted ) {
+    p0.push_back(ps[3]);
+    script.emplace_back([](const Vec3r& p, real_t t) { return p + Vec3r((real_t)0, (real_t)0, t); });
+  }
+  std::vector<pd::ProjDynBody> bodies;
+  bodies.emplace_back(std::move(ps), std::move(fs), scripted ? 3 : 4, std::move(p0),
+                      std::move(script));
+  auto& b = bodies.back();
+
+  // local vertex IDs of a cube: bit 0 -> y, bit 1 -> z, bit 2 -> x
+  static const uint32_t tets[5][4] = {
+      {0, 4, 1, 2}, {5, 1, 4, 7}, {6, 2, 7, 4}, {3, 7, 2, 1}, {4, 1, 2, 7}};
+  for(int i = 0;i < nx;++ i) {
+    for(auto const& t : tets) {
+      uint32_t v[4];
+      for(int k = 0;k < 4;++ k) v[k] = i * 4 + (t[k] & 3) + ((t[k] >> 2) * 4);
+      if ( shape::signed_tet_volume(b.vtx_pos(v[0]), b.vtx_pos(v[1]),
+                                    b.vtx_pos(v[2]), b.vtx_pos(v[3])) < 0 ) {
+        std::swap(v[1], v[2]);
+      }
+      b.add_energy<pd::TetCorotEnergy>(stiff, v[0], v[1], v[2], v[3]);
+    }
+  }
+  return pd::ProjDynScene<>(std::move(bodies));
+}
+
+TEST(TestProjDynSim, Gravity) {
+  TestSim sim(pd::SimStats((real_t)1E-2, 5), bar_scene(3, 1E3), pd::GlbCholeskySolver(), 
+              pd::MassForce());
+  for(int i = 0;i < 10;++ i) sim.step();
+  EXPECT_EQ(sim.stats().finished_steps, 10);
+
+  auto const& b = sim.scene().deformables()[0];
+  // fixed vertices stay in place
+  EXPECT_APPROX_EQ(b.vtx_pos(0).y(), 0);
+  // the free end sags: vertex 5 and 13 are at (1, 1, 0) and (3, 1, 0)
+  EXPECT_LT(b.vtx_pos(13).y(), 1);
+  EXPECT_LT(b.vtx_pos(13).y(), b.vtx_pos(5).y());
+}
+
+// max. vertex distance between the (single) bodies of two sims
+template <typename Sim_>
+static real_t pos_error(const Sim_& s1, const Sim_& s2) {
+  auto const& b1 = s1.scene().deformables()[0];
+  auto const& b2 = s2.scene().deformables()[0];
+  real_t err = 0;
+  for(size_t i = 0;i < b1.num_vtx();++ i) {
+    err = std::max(err, (b1.vtx_pos(i) - b2.vtx_pos(i)).norm());
+  }
+  return err;
+}
+
+// The bar is stiff so the plain iterations converge slowly. With the same 
+// number of iterations, the accelerated runs are closer to the converged one.
+TEST(TestProjDynSim, Chebyshev) {
+  TestSim ref(pd::SimStats((real_t)1E-2, 500), bar_scene(3, 1E5), 
+              pd::GlbCholeskySolver(), pd::MassForce());
+  TestSim plain(pd::SimStats((real_t)1E-2, 10), bar_scene(3, 1E5), 
+                pd::GlbCholeskySolver(), pd::MassForce());
+  TestSim cheby(pd::SimStats((real_t)1E-2, 10), bar_scene(3, 1E5), 
+                pd::GlbCholeskySolver(), pd::MassForce());
+  cheby.set_iter_accel(pd::ChebyshevAccel());
+  for(int i = 0;i < 20;++ i) {
+    ref.step();
+    plain.step();
+    cheby.step();
+  }
+  EXPECT_FALSE(std::get<pd::ChebyshevAccel>(cheby.iter_accel()).warming_up());
+
+  real_t const err_plain = pos_error(plain, ref);
+  real_t const err_cheby = pos_error(cheby, ref);
+  EXPECT_GT(err_plain, 0);
+  EXPECT_LT(err_cheby, err_plain);
+}
+
+TEST(TestProjDynSim, Anderson) {
+  TestSim ref(pd::SimStats((real_t)1E-2, 500), bar_scene(3, 1E5), 
+              pd::GlbCholeskySolver(), pd::MassForce());
+  TestSim plain(pd::SimStats((real_t)1E-2, 10), bar_scene(3, 1E5), 
+                pd::GlbCholeskySolver(), pd::MassForce());
+  TestSim aa(pd::SimStats((real_t)1E-2, 10), bar_scene(3, 1E5), 
+             pd::GlbCholeskySolver(), pd::MassForce());
+  aa.set_iter_accel(pd::AndersonAccel(3));
+  for(int i = 0;i < 20;++ i) {
+    ref.step();
+    plain.step();
+    aa.step();
+  }
+
+  real_t const err_plain = pos_error(plain, ref);
+  real_t const err_aa = pos_error(aa, ref);
+  EXPECT_GT(err_plain, 0);
+  EXPECT_LT(err_aa, err_plain);
+}
+
+TEST(TestProjDynSim, AdaptiveIterations) {
+  TestSim fixed(pd::SimStats((real_t)1E-2, 50), bar_scene(3, 1E3), 
+                pd::GlbCholeskySolver(), pd::MassForce());
+  // the updates of the last iterations are at the rounding level in float
+  constexpr bool f32 = std::is_same_v<real_t, float>;
+  const real_t tol = f32 ? (real_t)1E-3 : (real_t)1E-5;
+  TestSim adapt(pd::SimStats((real_t)1E-2, 50, tol, 2), bar_scene(3, 1E3), 
+                pd::GlbCholeskySolver(), pd::MassForce());
+  // the same bar away from the origin needs the same iterations in double. 
+  // In float, its updates reach the rounding level of the positions before 
+  // tol, which also stops the iterations.
+  TestSim moved(pd::SimStats((real_t)1E-2, 50, tol, 2), bar_scene(3, 1E3, false, f32 ? 10 : 1000), 
+                pd::GlbCholeskySolver(), pd::MassForce());
+  for(int i = 0;i < 5;++ i) {
+    fixed.step();
+    adapt.step();
+    moved.step();
+    EXPECT_EQ(fixed.stats().last_iter, 50);
+    EXPECT_GE(adapt.stats().last_iter, 2);
+    EXPECT_LT(adapt.stats().last_iter, 50);
+    if constexpr (f32) {
+      EXPECT_LE(moved.stats().last_iter, adapt.stats().last_iter + 1);
+    } else {
+      EXPECT_EQ(moved.stats().last_iter, adapt.stats().last_iter);
+    }
+  }
+  EXPECT_EQ(fixed.stats().total_iter, 250);
+  EXPECT_LT(adapt.stats().total_iter, 250);
+
+  auto const& b1 = fixed.scene().deformables()[0];
+  auto const& b2 = adapt.scene().deformables()[0];
+  for(size_t i = 0;i < b1.num_vtx();++ i) {
+    EXPECT_NEAR(b1.vtx_pos(i).x(), b2.vtx_pos(i).x(), 1E-3);
+    EXPECT_NEAR(b1.vtx_pos(i).y(), b2.vtx_pos(i).y(), 1E-3);
+    EXPECT_NEAR(b1.vtx_pos(i).z(), b2.vtx_pos(i).z(), 1E-3);
+  }
+}
+
+// changing the timestep after construction matches constructing with it
+TEST(TestProjDynSim, SetTimestep) {
+  TestSim sim0(pd::SimStats((real_t)1E-2, 5), bar_scene(3, 1E3), pd::GlbCholeskySolver(), 
+               pd::MassForce());
+  TestSim sim1(pd::SimStats((real_t)2E-2, 5), bar_scene(3, 1E3), pd::GlbCholeskySolver(), 
+               pd::MassForce());
+  sim0.set_timestep((real_t)2E-2);
+  EXPECT_EQ(sim0.stats().dt, (real_t)2E-2);
+  for(int i = 0;i < 10;++ i) {
+    sim0.step();
+    sim1.step();
+  }
+
+  auto const& b0 = sim0.scene().deformables()[0];
+  auto const& b1 = sim1.scene().deformables()[0];
+  for(size_t i = 0;i < b0.num_vtx();++ i) {
+    EXPECT_NEAR(b0.vtx_pos(i).y(), b1.vtx_pos(i).y(), 1E-4);
+  }
+
+  // change dt in the middle of a run: the time, and thus the scripted vertex,
+  // moves on continuously
+  TestSim sim2(pd::SimStats((real_t)1E-2, 5), bar_scene(3, 1E3, true), pd::GlbCholeskySolver(), 
+               pd::MassForce());
+  for(int i = 0;i < 5;++ i) sim2.step();
+  auto const& b2 = sim2.scene().deformables()[0];
+  EXPECT_NEAR(b2.vtx_pos(3).z(), 1.05, 1E-5);
+  sim2.set_timestep((real_t)2E-2);
+  sim2.step();
+  EXPECT_NEAR(sim2.stats().t(), 0.07, 1E-5);
+  EXPECT_NEAR(b2.vtx_pos(3).z(), 1.07, 1E-5);
+  for(int i = 0;i < 4;++ i) sim2.step();
+  EXPECT_EQ(sim2.stats().finished_steps, 10);
+  EXPECT_NEAR(sim2.stats().t(), 0.15, 1E-5);
+  EXPECT_NEAR(b2.vtx_pos(3).z(), 1.15, 1E-5);
+  EXPECT_APPROX_EQ(b2.vtx_pos(3).y(), 1);
+}
+
+// the local step runs in parallel over several chunks of terms, and gives the 
+// same results in every run
+TEST(TestProjDynSim, ParallelLocalStep) {
+  TestSim par(pd::SimStats((real_t)1E-2, 5), bar_scene(120, 1E3), pd::GlbCholeskySolver(), 
+              pd::MassForce());
+  TestSim ser(pd::SimStats((real_t)1E-2, 5), bar_scene(120, 1E3), pd::GlbCholeskySolver(), 
+              pd::MassForce());
+  // the reference runs all its local steps on a single thread
+  set_num_threads(4);
+  for(int i = 0;i < 5;++ i) par.step();
+  set_num_threads(1);
+  for(int i = 0;i < 5;++ i) ser.step();
+  set_num_threads(0);
+
+  auto const& b0 = par.scene().deformables()[0];
+  auto const& b1 = ser.scene().deformables()[0];
+  auto const& batch = *b0.energy_batches()[0];
+  ASSERT_GT(batch.size(), 2 * 256);
+  // the bar sags, so the terms are projected to non-trivial rotations
+  EXPECT_LT(b0.vtx_pos(b0.num_vtx() - 1).y(), 1);
+  for(size_t i = 0;i < b0.num_vtx();++ i) {
+    EXPECT_EQ(b0.vtx_pos(i).x(), b1.vtx_pos(i).x());
+    EXPECT_EQ(b0.vtx_pos(i).y(), b1.vtx_pos(i).y());
+    EXPECT_EQ(b0.vtx_pos(i).z(), b1.vtx_pos(i).z());
+  }
+}
+
+// The energy for the Anderson safeguard is summed by the parallel local step,
+// in the same order for any number of threads.
+TEST(TestProjDynSim, ParallelAndersonEnergy) {
+  TestSim par(pd::SimStats((real_t)1E-2, 10), bar_scene(120, 1E5), pd::GlbCholeskySolver(), 
+              pd::MassForce());
+  TestSim ser(pd::SimStats((real_t)1E-2, 10), bar_scene(120, 1E5), pd::GlbCholeskySolver(), 
+              pd::MassForce());
+  par.set_iter_accel(pd::AndersonAccel(3));
+  ser.set_iter_accel(pd::AndersonAccel(3));
+  set_num_threads(4);
+  for(int i = 0;i < 5;++ i) par.step();
+  set_num_threads(1);
+  for(int i = 0;i < 5;++ i) ser.step();
+  set_num_threads(0);
+
+  EXPECT_EQ(std::get<pd::AndersonAccel>(par.iter_accel()).num_rejected(),
+            std::get<pd::AndersonAccel>(ser.iter_accel()).num_rejected());
+  auto const& b0 = par.scene().deformables()[0];
+  auto const& b1 = ser.scene().deformables()[0];
+  for(size_t i = 0;i < b0.num_vtx();++ i) {
+    EXPECT_EQ(b0.vtx_pos(i).x(), b1.vtx_pos(i).x());
+    EXPECT_EQ(b0.vtx_pos(i).y(), b1.vtx_pos(i).y());
+    EXPECT_EQ(b0.vtx_pos(i).z(), b1.vtx_pos(i).z());
+  }
+}
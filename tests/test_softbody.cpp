@@ -8,8 +8,12 @@
 // obtain one at http://mozilla.org/MPL/2.0/.
 //******************************************************************************
 #include <gtest/gtest.h>
+#include <Eigen/Geometry>
+#include <Eigen/SVD>
 
 #include "doux/pd/softbody.h"
+#include "doux/pd/projective_energy.h"
+#include "doux/shape/tet.h"
 #include "common.h"
 
 TEST(TestPDSoftBody, Constr) {
@@ -31,4 +35,170 @@ TEST(TestPDSoftBody, Constr) {
   EXPECT_APPROX_EQ(sb.vtx_pos(1).x(), (real_t)2);
   EXPECT_APPROX_EQ(sb.vtx_pos(1).y(), (real_t)3);
   EXPECT_APPROX_EQ(sb.vtx_pos(1).z(), (real_t)3);
-}
\ No newline at end of file
+}
+TEST(TestPDSoftBody, EnergyBatch) {
+  using namespace doux;
+
+  std::vector<Vec3r> ps;
+  for(int i = 0;i < 5;++ i) ps.emplace_back((real_t)(i & 1), (real_t)((i >> 1) & 1), (real_t)(i >> 2));
+  linalg::matrix_i_t fs(1, 3);
+  fs << 0, 1, 2;
+  std::vector<pd::ProjDynBody> bodies;
+  auto& b = bodies.emplace_back(std::move(ps), std::move(fs), 1, std::vector<Vec3r>{},
+                                std::vector<pd::MotiveBody::MotionFunc>{});
+
+  auto const e0 = b.add_energy<pd::TetCorotEnergy>((real_t)10, 0, 1, 2, 4);
+  auto const e1 = b.add_energy<pd::TetCorotEnergy>((real_t)20, 1, 3, 2, 4);
+  EXPECT_TRUE(e0.batched());
+  EXPECT_EQ(e1.index(), 1);
+  // the terms are only stored in their batch
+  EXPECT_TRUE(b.internal_energies().empty());
+
+  // both terms are stored in one batch
+  ASSERT_EQ(b.energy_batches().size(), 1);
+  auto const& batch = b.energy_batch<pd::TetCorotBatch>();
+  EXPECT_EQ(batch.size(), 2);
+  EXPECT_EQ(batch.vtx(1, 1), 3);
+  EXPECT_TRUE(batch.restricted(0, 0));
+  EXPECT_FALSE(batch.restricted(1, 0));
+  EXPECT_APPROX_EQ(batch.stiffness(1), (real_t)20);
+
+  // F = \sum_j x_j c_j^T is the identity at the rest shape
+  linalg::mat3_r_t F = linalg::mat3_r_t::Zero();
+  for(int j = 0;j < 4;++ j) {
+    auto const& x = b.vtx_pos(batch.vtx(1, j));
+    F += linalg::vec3_r_t(x.x(), x.y(), x.z()) * batch.coeff(1, j).transpose();
+  }
+  EXPECT_NEAR((F - linalg::mat3_r_t::Identity()).norm(), 0., 1E-5);
+  EXPECT_NEAR(e1.val(), 0., 1E-5);
+}
+
+// project the 12 tets of two unit cubes deformed by the affine map A, and 
+// check that every term is projected to the rotation R. With rot_iters > 0,
+// the projection is repeated to converge the warm-started iterations.
+static void check_tet_corot_project(const doux::linalg::mat3_r_t& A, 
+                                    const doux::linalg::mat3_r_t& R,
+                                    uint32_t rot_iters = 0) {
+  using namespace doux;
+
+  std::vector<Vec3r> ps;
+  for(int i = 0;i < 12;++ i) ps.emplace_back((real_t)(i % 3), (real_t)((i / 3) & 1), (real_t)(i / 6));
+  linalg::matrix_i_t fs(1, 3);
+  fs << 0, 1, 2;
+  std::vector<pd::ProjDynBody> bodies;
+  auto& b = bodies.emplace_back(std::move(ps), std::move(fs));
+
+  // the 6 tets around the diagonal of each cube
+  static const int axes[6][3] = {{0,1,2}, {0,2,1}, {1,0,2}, {1,2,0}, {2,0,1}, {2,1,0}};
+  std::vector<pd::TetCorotEnergy> es;
+  for(int i = 0;i < 2;++ i) {
+    for(auto const& a : axes) {
+      int c[3] = {i, 0, 0};
+      size_t v[4];
+      v[0] = i;
+      for(int t = 0;t < 3;++ t) {
+        ++ c[a[t]];
+        v[t+1] = c[0] + c[1] * 3 + c[2] * 6;
+      }
+      if ( shape::signed_tet_volume(b.vtx_pos(v[0]), b.vtx_pos(v[1]),
+                                    b.vtx_pos(v[2]), b.vtx_pos(v[3])) < 0 ) {
+        std::swap(v[1], v[2]);
+      }
+      es.push_back(b.add_energy<pd::TetCorotEnergy>((real_t)1, v[0], v[1], v[2], v[3]));
+    }
+  }
+
+  // predicted positions A x
+  for(size_t i = 0;i < b.num_vtx();++ i) {
+    auto const& x = b.vtx_pos(i);
+    const linalg::vec3_r_t y = A * linalg::vec3_r_t(x.x(), x.y(), x.z());
+    b.vtx_vel()[i] = Vec3r(y(0), y(1), y(2)) - x;
+  }
+  b.predict_pos((real_t)1);
+
+  auto& batch = b.energy_batch<pd::TetCorotBatch>();
+  batch.set_rot_iters(rot_iters);
+  for(int i = 0;i < (rot_iters ? 20 : 1);++ i) b.project();
+  ASSERT_EQ(batch.size(), 12);
+  for(size_t t = 0;t < batch.size();++ t) {
+    EXPECT_NEAR((batch.rot(t) - R).norm(), 0., 1E-4);
+  }
+
+  // projecting a single term gives the same rotation
+  auto& e = es[5];
+  e.project();
+  EXPECT_NEAR((batch.rot(e.index()) - R).norm(), 0., 1E-4);
+}
+
+TEST(TestPDSoftBody, TetCorotProject) {
+  using namespace doux;
+
+  const linalg::mat3_r_t Q = Eigen::AngleAxis<real_t>((real_t)0.7, 
+      linalg::vec3_r_t(1, 2, 3).normalized()).toRotationMatrix();
+  linalg::mat3_r_t S;
+  S << 3, (real_t)0.5, 0,
+       (real_t)0.5, 1, (real_t)0.2, 
+       0, (real_t)0.2, (real_t)0.4;
+  check_tet_corot_project(linalg::mat3_r_t::Identity(), linalg::mat3_r_t::Identity());
+  // stretched and rotated
+  check_tet_corot_project(Q * S, Q);
+  // inverted: the closest rotation flips the smallest singular direction
+  check_tet_corot_project(Q * linalg::vec3_r_t(1, 2, (real_t)-0.5).asDiagonal(), Q);
+
+  // warm-started iterative extraction
+  check_tet_corot_project(linalg::mat3_r_t::Identity(), linalg::mat3_r_t::Identity(), 2);
+  check_tet_corot_project(Q * S, Q, 2);
+  check_tet_corot_project(Q * S, Q, 5);
+}
+
+// a sheet of 8 x 2 triangles in the plane z = 0, deformed by the affine map 
+// A: every term is projected to the orthonormal factor of F = A B, where the
+// columns of B are the rest frame of the triangle
+TEST(TestPDSoftBody, TriCorotProject) {
+  using namespace doux;
+  using mat32_t = Eigen::Matrix<real_t, 3, 2>;
+
+  const linalg::mat3_r_t Q = Eigen::AngleAxis<real_t>((real_t)0.7, 
+      linalg::vec3_r_t(1, 2, 3).normalized()).toRotationMatrix();
+  linalg::mat3_r_t S;
+  S << 3, (real_t)0.5, 0,
+       (real_t)0.5, 1, (real_t)0.2, 
+       0, (real_t)0.2, (real_t)0.4;
+  for(const linalg::mat3_r_t& A : {linalg::mat3_r_t(Q), linalg::mat3_r_t(Q * S)}) {
+    std::vector<Vec3r> ps;
+    for(int i = 0;i < 10;++ i) ps.emplace_back((real_t)(i % 5), (real_t)(i / 5), (real_t)0);
+    linalg::matrix_i_t fs(1, 3);
+    fs << 0, 1, 2;
+    std::vector<pd::ProjDynBody> bodies;
+    auto& b = bodies.emplace_back(std::move(ps), std::move(fs));
+    for(int i = 0;i < 4;++ i) {
+      b.add_energy<pd::TriCorotEnergy>((real_t)1, i, i + 1, i + 6);
+      b.add_energy<pd::TriCorotEnergy>((real_t)1, i, i + 6, i + 5);
+    }
+    auto& batch = b.energy_batch<pd::TriCorotBatch>();
+    ASSERT_EQ(batch.size(), 8);
+    for(size_t t = 0;t < batch.size();++ t) EXPECT_NEAR(batch.val(t, t + 1), 0., 1E-5);
+
+    for(size_t i = 0;i < b.num_vtx();++ i) {
+      auto const& x = b.vtx_pos(i);
+      const linalg::vec3_r_t y = A * linalg::vec3_r_t(x.x(), x.y(), x.z());
+      b.vtx_vel()[i] = Vec3r(y(0), y(1), y(2)) - x;
+    }
+    // rest frames
+    std::vector<mat32_t> B;
+    for(size_t t = 0;t < batch.size();++ t) B.push_back(batch.rot(t));
+    b.predict_pos((real_t)1);
+    b.project();
+
+    for(size_t t = 0;t < batch.size();++ t) {
+      const mat32_t F = A * B[t];
+      Eigen::JacobiSVD<mat32_t> svd(F, Eigen::ComputeFullU | Eigen::ComputeFullV);
+      const mat32_t R = svd.matrixU().leftCols<2>() * svd.matrixV().transpose();
+      EXPECT_NEAR((batch.rot(t) - R).norm(), 0., 1E-4);
+    }
+    // a rigid motion has zero energy
+    if ( A.isApprox(Q) ) {
+      for(size_t t = 0;t < batch.size();++ t) EXPECT_NEAR(batch.val(t, t + 1), 0., 1E-5);
+    }
+  }
+}